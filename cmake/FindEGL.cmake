@@ -0,0 +1,16 @@
+include(FindPackageHandleStandardArgs)
+
+find_path(EGL_INCLUDE_DIR
+          NAMES EGL/egl.h
+          PATHS
+          /usr/include
+          /usr/local/include)
+
+find_library(EGL_LIBRARY
+             NAMES libEGL.so EGL
+             PATHS
+             /usr/lib
+             /usr/local/lib
+             /usr/lib/x86_64-linux-gnu)
+
+find_package_handle_standard_args(EGL DEFAULT_MSG EGL_INCLUDE_DIR EGL_LIBRARY)
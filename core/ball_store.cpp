@@ -0,0 +1,167 @@
+#include "ball_store.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+static const int MIN_CAPACITY = 64;
+
+// ALIGNMENT の倍数になるように切り上げる
+static int roundUpCapacity(int n) {
+    const int floatsPerLine = BallStore::ALIGNMENT / (int)sizeof(float);
+    return (n + floatsPerLine - 1) / floatsPerLine * floatsPerLine;
+}
+
+
+BallStore::BallStore()
+: block_(NULL)
+, data_(NULL)
+, handles_(NULL)
+, capacity_(0)
+, head_(0)
+, tail_(0)
+, nextHandle_(0) {
+}
+
+BallStore::BallStore(const BallStore &other)
+: block_(NULL)
+, data_(NULL)
+, handles_(NULL)
+, capacity_(0)
+, head_(0)
+, tail_(0)
+, nextHandle_(0) {
+    *this = other;
+}
+
+BallStore &BallStore::operator=(const BallStore &other) {
+    if (this == &other) {
+        return *this;
+    }
+
+    clear();
+    reserve(other.size());
+    for (int c = 0; c < NUM_COLUMNS; c++) {
+        memcpy(column((Column)c), other.column((Column)c), sizeof(float) * other.size());
+    }
+    memcpy(handles_, other.handles(), sizeof(BallHandle) * other.size());
+    tail_ = other.size();
+    nextHandle_ = other.nextHandle_;
+    return *this;
+}
+
+BallStore::~BallStore() {
+    free(block_);
+    free(handles_);
+}
+
+void BallStore::reserve(int capacity) {
+    if (capacity > capacity_) {
+        compact(roundUpCapacity(capacity));
+    }
+}
+
+void BallStore::clear() {
+    head_ = 0;
+    tail_ = 0;
+}
+
+BallHandle BallStore::push() {
+    if (tail_ == capacity_) {
+        // 半分以上空いていれば詰め直すだけにする (償却 O(1))
+        if (size() * 2 <= capacity_ && capacity_ > 0) {
+            compact(0);
+        } else {
+            compact(roundUpCapacity(std::max(MIN_CAPACITY, capacity_ * 2)));
+        }
+    }
+    handles_[tail_] = nextHandle_++;
+    tail_++;
+    return handles_[tail_ - 1];
+}
+
+void BallStore::popFront() {
+    head_++;
+    if (head_ == tail_) {
+        head_ = 0;
+        tail_ = 0;
+    }
+}
+
+int BallStore::removeBelow(Column c, float limit) {
+    const float *values = column(c);
+    const int n = size();
+    int first = 0;
+    while (first < n && values[first] > limit) {
+        first++;
+    }
+    if (first == n) {
+        return 0;
+    }
+
+    // first 番目より後ろの残すボールを前に詰める (列ごとに同じ並びで動かす)
+    int kept = first;
+    for (int i = first; i < n; i++) {
+        if (values[i] > limit) {
+            for (int k = 0; k < NUM_COLUMNS; k++) {
+                float *col = column((Column)k);
+                col[kept] = col[i];
+            }
+            handles_[head_ + kept] = handles_[head_ + i];
+            kept++;
+        }
+    }
+    tail_ = head_ + kept;
+    if (head_ == tail_) {
+        head_ = 0;
+        tail_ = 0;
+    }
+    return n - kept;
+}
+
+int BallStore::indexOf(BallHandle handle) const {
+    const BallHandle *begin = handles();
+    const BallHandle *end = begin + size();
+    const BallHandle *found = std::lower_bound(begin, end, handle);
+    if (found == end || *found != handle) {
+        return -1;
+    }
+    return (int)(found - begin);
+}
+
+void BallStore::compact(int newCapacity) {
+    const int n = size();
+    if (newCapacity <= 0) {
+        for (int c = 0; c < NUM_COLUMNS; c++) {
+            float *col = data_ + (size_t)c * capacity_;
+            memmove(col, col + head_, sizeof(float) * n);
+        }
+        memmove(handles_, handles_ + head_, sizeof(BallHandle) * n);
+    } else {
+        void *block = malloc(sizeof(float) * (size_t)newCapacity * NUM_COLUMNS + ALIGNMENT);
+        if (block == NULL) {
+            throw std::bad_alloc();
+        }
+        float *data = (float*)(((uintptr_t)block + ALIGNMENT - 1) & ~(uintptr_t)(ALIGNMENT - 1));
+        BallHandle *handles = (BallHandle*)malloc(sizeof(BallHandle) * (size_t)newCapacity);
+        if (handles == NULL) {
+            free(block);
+            throw std::bad_alloc();
+        }
+        for (int c = 0; c < NUM_COLUMNS && n > 0; c++) {
+            memcpy(data + (size_t)c * newCapacity, column((Column)c), sizeof(float) * n);
+        }
+        if (n > 0) {
+            memcpy(handles, handles_ + head_, sizeof(BallHandle) * n);
+        }
+        free(block_);
+        free(handles_);
+        block_ = block;
+        data_ = data;
+        handles_ = handles;
+        capacity_ = newCapacity;
+    }
+    head_ = 0;
+    tail_ = n;
+}
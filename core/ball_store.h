@@ -0,0 +1,125 @@
+#ifndef _CORIOLIS_BALL_STORE_H_
+#define _CORIOLIS_BALL_STORE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// ふつうは投げた順に古い方から消えていくので, ボールはリングバッファ状に管理する.
+// ハンドルは投げた通し番号で, 消えるまでの間は常に同じボールを指す.
+typedef uint64_t BallHandle;
+
+// ボールの状態を構造体の配列ではなく, 要素ごとの配列 (SoA) として持つ.
+// 生きているボールは常に [0, size()) に投げた順 (ハンドルの昇順) に連続して並ぶ.
+// 途中のボールが先に消えることもある (removeBelow) ので, ハンドルは連続しているとは限らない.
+class BallStore {
+public:
+    enum Column {
+        RUN,        // 始点から終点への進み具合
+        SPEED_Y,    // 落下速度
+        POS_X,      // 現在位置
+        POS_Y,
+        POS_Z,
+        START_X,    // 始点
+        START_Z,
+        GOAL_X,     // 終点
+        GOAL_Z,
+        SPIN,       // ボール自身の回転角
+        AXIS_X,     // ボール自身の回転軸
+        AXIS_Z,
+        LOCAL_X,    // 円盤に固定した座標系での位置
+        LOCAL_Z,
+        VEL_X,      // 円盤に固定した座標系での速度
+        VEL_Z,
+        IMPACT,     // 直前のステップでピンに当たった時刻 (ステップに対する割合, 当たらなければ -1)
+        NUM_COLUMNS
+    };
+
+    // 確保した領域の先頭と容量 (列の間隔) はこのバイト数に揃える.
+    // column() は先頭のボール (head) の位置を返すので, popFront の後は揃っていない.
+    // カーネルは揃っていない読み書き (_mm256_loadu_ps など) を使うこと
+    static const int ALIGNMENT = 64;
+
+    BallStore();
+    BallStore(const BallStore &other);
+    BallStore &operator=(const BallStore &other);
+    ~BallStore();
+
+    // 容量が生きているボールの2倍以上ある間は, push() は詰め直すだけで確保し直さない
+    void reserve(int capacity);
+    void clear();
+
+    int size() const { return tail_ - head_; }
+    bool empty() const { return tail_ == head_; }
+    int capacity() const { return capacity_; }
+
+    // 末尾にボールを追加する (各列の値は呼び出し側で設定する)
+    BallHandle push();
+
+    // 一番古いボールを消す
+    void popFront();
+
+    // 列 c の値が limit 以下のボールを全部消し, 残りを順番を変えずに詰める. 消した数を返す
+    int removeBelow(Column c, float limit);
+
+    BallHandle handleAt(int index) const { return handles_[head_ + index]; }
+    const BallHandle *handles() const { return handles_ + head_; }
+
+    // 次に push() したボールのハンドル
+    BallHandle nextHandle() const { return nextHandle_; }
+
+    // 消えたボールのハンドルなら -1 を返す
+    int indexOf(BallHandle handle) const;
+
+    float *column(Column c) { return data_ + (size_t)c * capacity_ + head_; }
+    const float *column(Column c) const { return data_ + (size_t)c * capacity_ + head_; }
+
+    float *run() { return column(RUN); }
+    float *speedY() { return column(SPEED_Y); }
+    float *posX() { return column(POS_X); }
+    float *posY() { return column(POS_Y); }
+    float *posZ() { return column(POS_Z); }
+    float *startX() { return column(START_X); }
+    float *startZ() { return column(START_Z); }
+    float *goalX() { return column(GOAL_X); }
+    float *goalZ() { return column(GOAL_Z); }
+    float *spin() { return column(SPIN); }
+    float *axisX() { return column(AXIS_X); }
+    float *axisZ() { return column(AXIS_Z); }
+    float *localX() { return column(LOCAL_X); }
+    float *localZ() { return column(LOCAL_Z); }
+    float *velX() { return column(VEL_X); }
+    float *velZ() { return column(VEL_Z); }
+    float *impact() { return column(IMPACT); }
+
+    const float *run() const { return column(RUN); }
+    const float *speedY() const { return column(SPEED_Y); }
+    const float *posX() const { return column(POS_X); }
+    const float *posY() const { return column(POS_Y); }
+    const float *posZ() const { return column(POS_Z); }
+    const float *startX() const { return column(START_X); }
+    const float *startZ() const { return column(START_Z); }
+    const float *goalX() const { return column(GOAL_X); }
+    const float *goalZ() const { return column(GOAL_Z); }
+    const float *spin() const { return column(SPIN); }
+    const float *axisX() const { return column(AXIS_X); }
+    const float *axisZ() const { return column(AXIS_Z); }
+    const float *localX() const { return column(LOCAL_X); }
+    const float *localZ() const { return column(LOCAL_Z); }
+    const float *velX() const { return column(VEL_X); }
+    const float *velZ() const { return column(VEL_Z); }
+    const float *impact() const { return column(IMPACT); }
+
+private:
+    // 生きているボールを配列の先頭に詰め直す (newCapacity > 0 なら確保し直す)
+    void compact(int newCapacity);
+
+    void *block_;
+    float *data_;
+    BallHandle *handles_;       // ボールごとのハンドル (列と同じ並び)
+    int capacity_;
+    int head_;
+    int tail_;
+    BallHandle nextHandle_;
+};
+
+#endif  // _CORIOLIS_BALL_STORE_H_
@@ -0,0 +1,183 @@
+#include "game.h"
+
+#include <algorithm>
+
+static const float ARROW_ANGLE_SPEED = 0.9f;    // 1秒あたり
+static const float ARROW_COLOR_SPEED = 12.0f;   // 1秒あたり
+
+Game::Game()
+: lane_()
+, mode_(GAME_MODE_START)
+, modeSelect_(-1)
+, arrowAngle_(0.0f)
+, arrowColor_(5.0f)
+, arrowColorIndex_(5)
+, heldKeys_(0)
+, recorder_(NULL) {
+}
+
+Game::Game(const LaneConfig &config)
+: lane_(config)
+, mode_(GAME_MODE_START)
+, modeSelect_(-1)
+, arrowAngle_(0.0f)
+, arrowColor_(5.0f)
+, arrowColorIndex_(5)
+, heldKeys_(0)
+, recorder_(NULL) {
+}
+
+void Game::press(PressedKey key) {
+    if (recorder_) {
+        recorder_->record(lane_.tick(), INPUT_PRESS, key);
+    }
+
+    if (mode_ == GAME_MODE_PLAY) {
+        // Space --- viewmode change
+        if (key == PRESSED_SPACE) {
+            modeSelect_ *= -1;
+        }
+
+        // Enter --- throwing
+        if (key == PRESSED_ENTER) {
+            lane_.throwBall(arrowAngle_);
+        }
+        if (key == PRESSED_ESCAPE) {
+            mode_ = GAME_MODE_START;
+        }
+    }
+    else {
+        if (key == PRESSED_ENTER) {
+            if (mode_ == GAME_MODE_START) {
+                mode_ = GAME_MODE_PLAY;
+                arrowAngle_ = 0.0f;
+            }
+        }
+    }
+}
+
+void Game::step(unsigned int heldKeys) {
+    // スタート画面ではレーンは止まっている
+    if (mode_ != GAME_MODE_PLAY) {
+        return;
+    }
+
+    if (recorder_ && heldKeys != heldKeys_) {
+        recorder_->record(lane_.tick(), INPUT_HELD, heldKeys);
+    }
+    heldKeys_ = heldKeys;
+
+    const float dt = lane_.config().dt;
+    if (heldKeys & HELD_LEFT) {
+        arrowAngle_ += ARROW_ANGLE_SPEED * dt;
+        arrowAngle_ = std::min(arrowAngle_, +1.5f);
+    }
+    if (heldKeys & HELD_RIGHT) {
+        arrowAngle_ -= ARROW_ANGLE_SPEED * dt;
+        arrowAngle_ = std::max(arrowAngle_, -1.5f);
+    }
+    if (heldKeys & HELD_UP) {
+        arrowColor_ += ARROW_COLOR_SPEED * dt;
+        arrowColorIndex_ = std::max(0, std::min(int(arrowColor_), 9));
+    }
+    if (heldKeys & HELD_DOWN) {
+        arrowColor_ -= ARROW_COLOR_SPEED * dt;
+        arrowColorIndex_ = std::max(0, std::min(int(arrowColor_), 9));
+    }
+    lane_.setSpeedIndex(arrowColorIndex_);
+    lane_.step();
+
+    if (recorder_) {
+        recorder_->record(lane_.tick(), INPUT_CHECKSUM, (uint32_t)checksum());
+    }
+}
+
+uint64_t Game::checksum() const {
+    uint64_t hash = lane_.checksum();
+    const float values[] = { arrowAngle_, arrowColor_ };
+    const int states[] = { mode_, modeSelect_, arrowColorIndex_ };
+    const unsigned char *bytes = (const unsigned char *)values;
+    for (size_t k = 0; k < sizeof(values); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+    bytes = (const unsigned char *)states;
+    for (size_t k = 0; k < sizeof(states); k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+ReplayResult replayInputLog(const InputLog &log, Game &game, FILE *checksumOut) {
+    ReplayResult result;
+    result.ticks = 0;
+    result.events = 0;
+    result.checksums = 0;
+    result.firstMismatch = -1;
+    result.desync = false;
+
+    const std::vector<InputEvent> &events = log.events();
+    unsigned int heldKeys = 0;
+    for (size_t e = 0; e < events.size(); e++) {
+        const InputEvent &event = events[e];
+
+        // 次のイベントのステップまで, 押されているキーをそのままにして進める
+        while (game.tick() < event.tick) {
+            if (game.mode() != GAME_MODE_PLAY) {
+                result.desync = true;
+                return result;
+            }
+            game.step(heldKeys);
+            result.ticks++;
+            if (checksumOut) {
+                fprintf(checksumOut, "%llu %08x\n", game.tick(), (uint32_t)game.checksum());
+            }
+        }
+
+        switch (event.type) {
+            case INPUT_HELD:
+                heldKeys = event.value;
+                break;
+            case INPUT_PRESS:
+                game.press((PressedKey)event.value);
+                break;
+            case INPUT_CHECKSUM:
+                result.checksums++;
+                if (result.firstMismatch < 0 && event.value != (uint32_t)game.checksum()) {
+                    result.firstMismatch = (long long)event.tick;
+                }
+                break;
+            default:
+                break;
+        }
+        result.events++;
+    }
+    return result;
+}
+
+InputPlayer::InputPlayer(const InputLog &log)
+: log_(log)
+, next_(0)
+, heldKeys_(0)
+, desync_(false) {
+}
+
+bool InputPlayer::step(Game &game) {
+    const std::vector<InputEvent> &events = log_.events();
+    while (next_ < events.size() && events[next_].tick <= game.tick()) {
+        const InputEvent &event = events[next_++];
+        if (event.type == INPUT_HELD) {
+            heldKeys_ = event.value;
+        } else if (event.type == INPUT_PRESS) {
+            game.press((PressedKey)event.value);
+        }
+    }
+    if (finished()) {
+        return false;
+    }
+    if (game.mode() != GAME_MODE_PLAY) {
+        desync_ = true;
+        return false;
+    }
+    game.step(heldKeys_);
+    return true;
+}
@@ -0,0 +1,88 @@
+#ifndef _CORIOLIS_GAME_H_
+#define _CORIOLIS_GAME_H_
+
+#include <cstdio>
+
+#include "input_log.h"
+#include "lane.h"
+
+// キー入力からレーンを動かすゲームの進行 (OpenGL/GLFW には依存しない).
+// keyboard() と keyboardCallback() がしていたことをここにまとめて, 記録した入力をそのまま再生できるようにする.
+
+enum GameMode {
+    GAME_MODE_START,
+    GAME_MODE_PLAY,
+    GAME_MODE_CLEAR
+};
+
+class Game {
+public:
+    Game();
+    explicit Game(const LaneConfig &config);
+
+    // キーが押された (keyboardCallback から呼ぶ)
+    void press(PressedKey key);
+
+    // 押されているキー (HeldKey のビットマスク) を反映してから, レーンを1ステップ進める
+    // (プレイ中でなければ何もしない)
+    void step(unsigned int heldKeys);
+
+    // 入力とチェックサムを記録する (NULL なら記録しない)
+    void setRecorder(InputRecorder *recorder) { recorder_ = recorder; }
+
+    Lane &lane() { return lane_; }
+    const Lane &lane() const { return lane_; }
+    unsigned long long tick() const { return lane_.tick(); }
+
+    GameMode mode() const { return mode_; }
+    int modeSelect() const { return modeSelect_; }
+    float arrowAngle() const { return arrowAngle_; }
+    int arrowColorIndex() const { return arrowColorIndex_; }
+
+    // レーンとプレイヤーの状態のハッシュ (ログには下位32ビットを書く)
+    uint64_t checksum() const;
+
+private:
+    Lane lane_;
+    GameMode mode_;
+    int modeSelect_;            // 視点 (-1: 投げる人の後ろから, 1: 上から)
+    float arrowAngle_;
+    float arrowColor_;
+    int arrowColorIndex_;       // 矢印の色 (= ボールの速さ)
+    unsigned int heldKeys_;     // 直前に記録した押されているキー
+    InputRecorder *recorder_;
+};
+
+struct ReplayResult {
+    unsigned long long ticks;       // 進めたステップ数
+    int events;                     // 再生したイベントの数
+    int checksums;                  // 確かめたチェックサムの数
+    long long firstMismatch;        // チェックサムが最初に食い違ったステップ (なければ -1)
+    bool desync;                    // ステップを進められない状態でステップを要求された
+};
+
+// ログの入力を1ステップずつ game に与える (描画しながら再生するとき).
+// イベントを与える順番は replayInputLog と同じなので, 同じ状態をたどる. チェックサムは確かめない.
+class InputPlayer {
+public:
+    explicit InputPlayer(const InputLog &log);
+
+    // 今のステップまでのイベントを与えてから, 1ステップ進める.
+    // ログの終わりまで来たか, プレイ中でなくて進められなければ false
+    bool step(Game &game);
+
+    bool finished() const { return next_ >= log_.events().size(); }
+    bool desync() const { return desync_; }
+
+private:
+    const InputLog &log_;
+    size_t next_;               // 次に与えるイベント
+    unsigned int heldKeys_;
+    bool desync_;
+};
+
+// ログの入力を game に順に与えて, 描画せずに全速力で再生する.
+// checksumOut を渡すとステップごとのチェックサムを書き出す.
+ReplayResult replayInputLog(const InputLog &log, Game &game, FILE *checksumOut = NULL);
+
+#endif  // _CORIOLIS_GAME_H_
@@ -0,0 +1,177 @@
+#include "input_log.h"
+
+static const char MAGIC[4] = { 'C', 'R', 'I', 'L' };
+static const uint32_t VERSION = 1;
+
+static void writeU32(FILE *fp, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void writeF32(FILE *fp, float value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+// 7ビットずつ, 続きがあれば最上位ビットを立てて書く
+static void writeVarint(FILE *fp, unsigned long long value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, fp);
+        value >>= 7;
+    }
+    fputc((int)value, fp);
+}
+
+static bool readU32(FILE *fp, uint32_t *value) {
+    return fread(value, sizeof(*value), 1, fp) == 1;
+}
+
+static bool readF32(FILE *fp, float *value) {
+    return fread(value, sizeof(*value), 1, fp) == 1;
+}
+
+static bool readVarint(FILE *fp, unsigned long long *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        const int c = fgetc(fp);
+        if (c == EOF) {
+            return false;
+        }
+        *value |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+InputRecorder::InputRecorder()
+: fp_(NULL)
+, lastTick_(0) {
+}
+
+InputRecorder::~InputRecorder() {
+    close();
+}
+
+bool InputRecorder::open(const std::string &filename, const LaneConfig &config) {
+    close();
+    fp_ = fopen(filename.c_str(), "wb");
+    if (!fp_) {
+        return false;
+    }
+    lastTick_ = 0;
+
+    fwrite(MAGIC, 1, sizeof(MAGIC), fp_);
+    writeU32(fp_, VERSION);
+    writeF32(fp_, config.diskRadius);
+    writeF32(fp_, config.releaseRadius);
+    writeF32(fp_, config.releaseHeight);
+    writeF32(fp_, config.pinRadius);
+    writeF32(fp_, config.pinHeight);
+    writeF32(fp_, config.hitRadius);
+    writeF32(fp_, config.gravity);
+    writeF32(fp_, config.dropHeight);
+    writeF32(fp_, config.omega);
+    writeF32(fp_, config.spinRate);
+    writeF32(fp_, config.dt);
+    writeU32(fp_, (uint32_t)config.dynamics);
+    writeU32(fp_, (uint32_t)config.ballBudget);
+    writeU32(fp_, (uint32_t)config.maxBalls);
+    return true;
+}
+
+void InputRecorder::close() {
+    if (fp_) {
+        record(lastTick_, INPUT_END, 0);
+        fclose(fp_);
+        fp_ = NULL;
+    }
+}
+
+void InputRecorder::record(unsigned long long tick, InputEventType type, uint32_t value) {
+    if (!fp_) {
+        return;
+    }
+    writeVarint(fp_, tick - lastTick_);
+    fputc((int)type, fp_);
+    if (type == INPUT_CHECKSUM) {
+        writeU32(fp_, value);
+    } else if (type != INPUT_END) {
+        fputc((int)value, fp_);
+    }
+    lastTick_ = tick;
+}
+
+bool InputLog::load(const std::string &filename) {
+    events_.clear();
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        return false;
+    }
+
+    char magic[4];
+    uint32_t version = 0;
+    uint32_t dynamics = 0, ballBudget = 0, maxBalls = 0;
+    bool ok = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+              magic[0] == MAGIC[0] && magic[1] == MAGIC[1] && magic[2] == MAGIC[2] && magic[3] == MAGIC[3] &&
+              readU32(fp, &version) && version == VERSION &&
+              readF32(fp, &config_.diskRadius) &&
+              readF32(fp, &config_.releaseRadius) &&
+              readF32(fp, &config_.releaseHeight) &&
+              readF32(fp, &config_.pinRadius) &&
+              readF32(fp, &config_.pinHeight) &&
+              readF32(fp, &config_.hitRadius) &&
+              readF32(fp, &config_.gravity) &&
+              readF32(fp, &config_.dropHeight) &&
+              readF32(fp, &config_.omega) &&
+              readF32(fp, &config_.spinRate) &&
+              readF32(fp, &config_.dt) &&
+              readU32(fp, &dynamics) && dynamics < NUM_DYNAMICS &&
+              readU32(fp, &ballBudget) &&
+              readU32(fp, &maxBalls);
+    config_.dynamics = (Dynamics)dynamics;
+    config_.ballBudget = (int)ballBudget;
+    config_.maxBalls = (int)maxBalls;
+
+    // 最後まで記録できなかったログ (途中で落ちたときなど) も, 読めたところまでは使う.
+    // 最後のイベントが途中で切れていたら (種類でも値でも) そこで止め, それまでのイベントを返す.
+    // 失敗にするのはヘッダが読めないときと, 知らない種類のイベントがあったときだけ
+    unsigned long long tick = 0;
+    while (ok) {
+        unsigned long long delta;
+        if (!readVarint(fp, &delta)) {
+            break;
+        }
+        const int type = fgetc(fp);
+        if (type == EOF) {
+            break;
+        }
+        if (type > INPUT_END) {
+            ok = false;
+            break;
+        }
+
+        InputEvent event;
+        tick += delta;
+        event.tick = tick;
+        event.type = (InputEventType)type;
+        event.value = 0;
+        if (event.type == INPUT_CHECKSUM) {
+            if (!readU32(fp, &event.value)) {
+                break;
+            }
+        } else if (event.type != INPUT_END) {
+            const int c = fgetc(fp);
+            if (c == EOF) {
+                break;
+            }
+            event.value = (uint32_t)c;
+        }
+        if (event.type == INPUT_END) {
+            break;
+        }
+        events_.push_back(event);
+    }
+
+    fclose(fp);
+    return ok;
+}
@@ -0,0 +1,86 @@
+#ifndef _CORIOLIS_INPUT_LOG_H_
+#define _CORIOLIS_INPUT_LOG_H_
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "lane.h"
+
+// キー入力をシミュレーションのステップ番号つきで記録したログ.
+//
+// ファイルの形式 (リトルエンディアン):
+//   char[4] "CRIL", uint32 version (=1), LaneConfig の各値 (float 11個, uint32 3個),
+//   以降はイベントの列. 各イベントは
+//     varint (直前のイベントからのステップ数の差), uint8 種類, 種類ごとの値
+//   で, 種類は
+//     INPUT_HELD     押されているキーが変わった (uint8 のビットマスク)
+//     INPUT_PRESS    キーが押された (uint8 の PressedKey)
+//     INPUT_CHECKSUM ステップを進めた後の状態のチェックサム (uint32)
+//     INPUT_END      記録の終わり
+
+// 毎ステップ押されているかを見るキー
+enum HeldKey {
+    HELD_LEFT = 1 << 0,
+    HELD_RIGHT = 1 << 1,
+    HELD_UP = 1 << 2,
+    HELD_DOWN = 1 << 3
+};
+
+// 押した瞬間だけを見るキー
+enum PressedKey {
+    PRESSED_SPACE,
+    PRESSED_ENTER,
+    PRESSED_ESCAPE,
+    NUM_PRESSED_KEYS
+};
+
+enum InputEventType {
+    INPUT_HELD,
+    INPUT_PRESS,
+    INPUT_CHECKSUM,
+    INPUT_END
+};
+
+struct InputEvent {
+    unsigned long long tick;    // イベントが起きたときのステップ番号
+    InputEventType type;
+    uint32_t value;
+};
+
+// 記録しながらファイルに書き出す
+class InputRecorder {
+public:
+    InputRecorder();
+    ~InputRecorder();
+
+    bool open(const std::string &filename, const LaneConfig &config);
+    void close();
+    bool isOpen() const { return fp_ != NULL; }
+
+    void record(unsigned long long tick, InputEventType type, uint32_t value);
+
+private:
+    InputRecorder(const InputRecorder &);
+    InputRecorder &operator=(const InputRecorder &);
+
+    FILE *fp_;
+    unsigned long long lastTick_;
+};
+
+// 記録したログを読み込む
+class InputLog {
+public:
+    // ヘッダが読めないか, 知らない種類のイベントがあれば false. 途中で切れたログは読めたところまで使う
+    bool load(const std::string &filename);
+
+    const LaneConfig &config() const { return config_; }
+    const std::vector<InputEvent> &events() const { return events_; }
+
+private:
+    LaneConfig config_;
+    std::vector<InputEvent> events_;
+};
+
+#endif  // _CORIOLIS_INPUT_LOG_H_
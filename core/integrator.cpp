@@ -0,0 +1,154 @@
+#include "integrator.h"
+
+#if defined(CORIOLIS_SIMD_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+int integrateBallsScalar(const BallSpan &span, const IntegrateParams &params) {
+    int hits = 0;
+    for (int i = 0; i < span.count; i++) {
+        const float oldX = span.posX[i];
+        const float oldY = span.posY[i];
+        const float oldZ = span.posZ[i];
+        span.run[i] += params.speed;
+        span.spin[i] -= params.spinStep;
+
+        const float run = span.run[i];
+        span.posX[i] = run * span.goalX[i] + (1.0f - run) * span.startX[i];
+        span.posZ[i] = run * span.goalZ[i] + (1.0f - run) * span.startZ[i];
+
+        // 円盤の外に出たら落下させる
+        if (span.posX[i] * span.posX[i] + span.posZ[i] * span.posZ[i] >= params.diskRadius2) {
+            span.speedY[i] += params.gravity;
+            span.posY[i] -= span.speedY[i];
+        }
+
+        // 当たり判定 (ステップの間のボールとピンの動きを直線で結ぶ)
+        span.impact[i] = sweptImpact(oldX - params.pinPrev[0], oldY - params.pinPrev[1], oldZ - params.pinPrev[2],
+                                     span.posX[i] - params.pin[0], span.posY[i] - params.pin[1],
+                                     span.posZ[i] - params.pin[2], params.hitRadius2);
+        if (span.impact[i] >= 0.0f) {
+            hits++;
+        }
+    }
+    return hits;
+}
+
+#if !defined(CORIOLIS_SIMD_X86)
+// x86 以外ではスカラー版だけを使う
+int integrateBallsSSE4(const BallSpan &span, const IntegrateParams &params) {
+    return integrateBallsScalar(span, params);
+}
+
+int integrateBallsAVX2(const BallSpan &span, const IntegrateParams &params) {
+    return integrateBallsScalar(span, params);
+}
+#endif
+
+BallSpan ballSpan(BallStore &balls) {
+    BallSpan span;
+    span.run = balls.run();
+    span.speedY = balls.speedY();
+    span.posX = balls.posX();
+    span.posY = balls.posY();
+    span.posZ = balls.posZ();
+    span.startX = balls.startX();
+    span.startZ = balls.startZ();
+    span.goalX = balls.goalX();
+    span.goalZ = balls.goalZ();
+    span.spin = balls.spin();
+    span.impact = balls.impact();
+    span.count = balls.size();
+    return span;
+}
+
+#if defined(CORIOLIS_SIMD_X86)
+static void cpuid(int leaf, int sub, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, leaf, sub);
+    for (int k = 0; k < 4; k++) {
+        regs[k] = (unsigned int)r[k];
+    }
+#else
+    __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// OS が YMM レジスタを保存してくれるか
+static bool osSupportsAVX() {
+    unsigned int regs[4];
+    cpuid(1, 0, regs);
+    if (!(regs[2] & (1u << 27))) {  // OSXSAVE
+        return false;
+    }
+#if defined(_MSC_VER)
+    const unsigned long long xcr0 = _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    const unsigned long long xcr0 = ((unsigned long long)edx << 32) | eax;
+#endif
+    return (xcr0 & 0x6) == 0x6;
+}
+#endif
+
+bool integratorSupported(IntegratorKind kind) {
+    switch (kind) {
+        case INTEGRATOR_SCALAR:
+            return true;
+#if defined(CORIOLIS_SIMD_X86)
+        case INTEGRATOR_SSE4:
+        {
+            unsigned int regs[4];
+            cpuid(1, 0, regs);
+            return (regs[2] & (1u << 19)) != 0;
+        }
+        case INTEGRATOR_AVX2:
+        {
+            unsigned int regs[4];
+            cpuid(0, 0, regs);
+            if (regs[0] < 7 || !osSupportsAVX()) {
+                return false;
+            }
+            cpuid(7, 0, regs);
+            return (regs[1] & (1u << 5)) != 0;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+IntegratorKind bestIntegrator() {
+    static const IntegratorKind kind = integratorSupported(INTEGRATOR_AVX2) ? INTEGRATOR_AVX2 :
+                                       integratorSupported(INTEGRATOR_SSE4) ? INTEGRATOR_SSE4 :
+                                                                              INTEGRATOR_SCALAR;
+    return kind;
+}
+
+IntegrateFunc integratorFunc(IntegratorKind kind) {
+    switch (kind) {
+        case INTEGRATOR_SSE4:
+            return integrateBallsSSE4;
+        case INTEGRATOR_AVX2:
+            return integrateBallsAVX2;
+        default:
+            return integrateBallsScalar;
+    }
+}
+
+const char *integratorName(IntegratorKind kind) {
+    switch (kind) {
+        case INTEGRATOR_SSE4:
+            return "sse4";
+        case INTEGRATOR_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef _CORIOLIS_INTEGRATOR_H_
+#define _CORIOLIS_INTEGRATOR_H_
+
+#include <cmath>
+
+#include "ball_store.h"
+
+// ボールの列を1ステップ進めるカーネル.
+// どの実装も計算順序を揃えてあるので, 結果はビット単位で一致する.
+
+struct IntegrateParams {
+    float speed;            // 1ステップあたりの run の増分
+    float spinStep;         // 1ステップあたりのボール自身の回転角
+    float diskRadius2;      // 円盤の半径の2乗
+    float gravity;          // 1ステップあたりの落下速度の増分
+    float pin[3];           // ピンの位置
+    float pinPrev[3];       // 1ステップ前のピンの位置
+    float hitRadius2;       // 当たり判定の距離の2乗
+};
+
+struct BallSpan {
+    float *run;
+    float *speedY;
+    float *posX;
+    float *posY;
+    float *posZ;
+    const float *startX;
+    const float *startZ;
+    const float *goalX;
+    const float *goalZ;
+    float *spin;
+    float *impact;
+    int count;
+};
+
+// ステップの始め (d0) と終わり (d1) のピンから見たボールの位置を直線で結び,
+// 当たり判定の球に初めて入る時刻をステップに対する割合 [0, 1] で返す (入らなければ -1).
+// ボールが速くてもステップの間にピンをすり抜けない.
+// ステップの終わりで球の中にあれば, 丸め誤差があっても必ず当たりにする.
+inline float sweptImpact(float d0x, float d0y, float d0z, float d1x, float d1y, float d1z, float hitRadius2) {
+    const float ex = d1x - d0x;
+    const float ey = d1y - d0y;
+    const float ez = d1z - d0z;
+    const float a = ex * ex + ey * ey + ez * ez;
+    const float b = d0x * ex + d0y * ey + d0z * ez;
+    const float c0 = d0x * d0x + d0y * d0y + d0z * d0z;
+    const float c1 = d1x * d1x + d1y * d1y + d1z * d1z;
+    const float disc = b * b - a * (c0 - hitRadius2);
+    if (c0 <= hitRadius2) {
+        return 0.0f;
+    }
+    if (disc >= 0.0f && b < 0.0f) {
+        const float s = (-b - std::sqrt(disc)) / a;
+        if (s <= 1.0f) {
+            return s;
+        }
+    }
+    return c1 <= hitRadius2 ? 1.0f : -1.0f;
+}
+
+enum IntegratorKind {
+    INTEGRATOR_SCALAR,
+    INTEGRATOR_SSE4,
+    INTEGRATOR_AVX2,
+    NUM_INTEGRATORS
+};
+
+// 戻り値はステップの間にピンに当たったボールの数 (当たった時刻は span.impact に書く)
+typedef int (*IntegrateFunc)(const BallSpan &span, const IntegrateParams &params);
+
+int integrateBallsScalar(const BallSpan &span, const IntegrateParams &params);
+int integrateBallsSSE4(const BallSpan &span, const IntegrateParams &params);
+int integrateBallsAVX2(const BallSpan &span, const IntegrateParams &params);
+
+BallSpan ballSpan(BallStore &balls);
+
+// この CPU で使えるか (CPUID で判定する)
+bool integratorSupported(IntegratorKind kind);
+
+// 使える中で一番速い実装
+IntegratorKind bestIntegrator();
+
+IntegrateFunc integratorFunc(IntegratorKind kind);
+const char *integratorName(IntegratorKind kind);
+
+#endif  // _CORIOLIS_INTEGRATOR_H_
@@ -0,0 +1,91 @@
+#include "integrator.h"
+
+#include <immintrin.h>
+
+// 8個ずつまとめて進める (AVX2)
+int integrateBallsAVX2(const BallSpan &span, const IntegrateParams &params) {
+    const __m256 speed = _mm256_set1_ps(params.speed);
+    const __m256 spinStep = _mm256_set1_ps(params.spinStep);
+    const __m256 diskRadius2 = _mm256_set1_ps(params.diskRadius2);
+    const __m256 gravity = _mm256_set1_ps(params.gravity);
+    const __m256 pinX = _mm256_set1_ps(params.pin[0]);
+    const __m256 pinY = _mm256_set1_ps(params.pin[1]);
+    const __m256 pinZ = _mm256_set1_ps(params.pin[2]);
+    const __m256 pinPrevX = _mm256_set1_ps(params.pinPrev[0]);
+    const __m256 pinPrevY = _mm256_set1_ps(params.pinPrev[1]);
+    const __m256 pinPrevZ = _mm256_set1_ps(params.pinPrev[2]);
+    const __m256 hitRadius2 = _mm256_set1_ps(params.hitRadius2);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 minusOne = _mm256_set1_ps(-1.0f);
+    const __m256 signBit = _mm256_set1_ps(-0.0f);
+
+    int hits = 0;
+    int i = 0;
+    for (; i + 8 <= span.count; i += 8) {
+        // ステップの始めのピンから見た位置
+        const __m256 d0x = _mm256_sub_ps(_mm256_loadu_ps(span.posX + i), pinPrevX);
+        const __m256 d0y = _mm256_sub_ps(_mm256_loadu_ps(span.posY + i), pinPrevY);
+        const __m256 d0z = _mm256_sub_ps(_mm256_loadu_ps(span.posZ + i), pinPrevZ);
+
+        const __m256 run = _mm256_add_ps(_mm256_loadu_ps(span.run + i), speed);
+        _mm256_storeu_ps(span.run + i, run);
+        _mm256_storeu_ps(span.spin + i, _mm256_sub_ps(_mm256_loadu_ps(span.spin + i), spinStep));
+
+        const __m256 rest = _mm256_sub_ps(one, run);
+        const __m256 posX = _mm256_add_ps(_mm256_mul_ps(run, _mm256_loadu_ps(span.goalX + i)),
+                                       _mm256_mul_ps(rest, _mm256_loadu_ps(span.startX + i)));
+        const __m256 posZ = _mm256_add_ps(_mm256_mul_ps(run, _mm256_loadu_ps(span.goalZ + i)),
+                                       _mm256_mul_ps(rest, _mm256_loadu_ps(span.startZ + i)));
+        _mm256_storeu_ps(span.posX + i, posX);
+        _mm256_storeu_ps(span.posZ + i, posZ);
+
+        // 円盤の外に出たものだけ落下させる
+        const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(posX, posX), _mm256_mul_ps(posZ, posZ));
+        const __m256 off = _mm256_cmp_ps(r2, diskRadius2, _CMP_GE_OQ);
+        __m256 speedY = _mm256_loadu_ps(span.speedY + i);
+        __m256 posY = _mm256_loadu_ps(span.posY + i);
+        speedY = _mm256_blendv_ps(speedY, _mm256_add_ps(speedY, gravity), off);
+        posY = _mm256_blendv_ps(posY, _mm256_sub_ps(posY, speedY), off);
+        _mm256_storeu_ps(span.speedY + i, speedY);
+        _mm256_storeu_ps(span.posY + i, posY);
+
+        // 当たり判定 (sweptImpact() と同じ順序で計算する)
+        const __m256 d1x = _mm256_sub_ps(posX, pinX);
+        const __m256 d1y = _mm256_sub_ps(posY, pinY);
+        const __m256 d1z = _mm256_sub_ps(posZ, pinZ);
+        const __m256 ex = _mm256_sub_ps(d1x, d0x);
+        const __m256 ey = _mm256_sub_ps(d1y, d0y);
+        const __m256 ez = _mm256_sub_ps(d1z, d0z);
+        const __m256 a = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(ez, ez));
+        const __m256 b = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0x, ex), _mm256_mul_ps(d0y, ey)), _mm256_mul_ps(d0z, ez));
+        const __m256 c0 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d0x, d0x), _mm256_mul_ps(d0y, d0y)), _mm256_mul_ps(d0z, d0z));
+        const __m256 c1 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d1x, d1x), _mm256_mul_ps(d1y, d1y)), _mm256_mul_ps(d1z, d1z));
+        const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(a, _mm256_sub_ps(c0, hitRadius2)));
+        const __m256 s = _mm256_div_ps(_mm256_sub_ps(_mm256_xor_ps(b, signBit), _mm256_sqrt_ps(_mm256_max_ps(disc, zero))), a);
+        const __m256 swept = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(disc, zero, _CMP_GE_OQ), _mm256_cmp_ps(b, zero, _CMP_LT_OQ)), _mm256_cmp_ps(s, one, _CMP_LE_OQ));
+        __m256 impact = _mm256_blendv_ps(minusOne, one, _mm256_cmp_ps(c1, hitRadius2, _CMP_LE_OQ));
+        impact = _mm256_blendv_ps(impact, s, swept);
+        impact = _mm256_blendv_ps(impact, zero, _mm256_cmp_ps(c0, hitRadius2, _CMP_LE_OQ));
+        _mm256_storeu_ps(span.impact + i, impact);
+        int mask = _mm256_movemask_ps(_mm256_cmp_ps(impact, zero, _CMP_GE_OQ));
+        for (; mask != 0; mask &= mask - 1) {
+            hits++;
+        }
+    }
+
+    BallSpan tail = span;
+    tail.run += i;
+    tail.speedY += i;
+    tail.posX += i;
+    tail.posY += i;
+    tail.posZ += i;
+    tail.startX += i;
+    tail.startZ += i;
+    tail.goalX += i;
+    tail.goalZ += i;
+    tail.spin += i;
+    tail.impact += i;
+    tail.count -= i;
+    return hits + integrateBallsScalar(tail, params);
+}
@@ -0,0 +1,91 @@
+#include "integrator.h"
+
+#include <smmintrin.h>
+
+// 4個ずつまとめて進める (SSE4.1)
+int integrateBallsSSE4(const BallSpan &span, const IntegrateParams &params) {
+    const __m128 speed = _mm_set1_ps(params.speed);
+    const __m128 spinStep = _mm_set1_ps(params.spinStep);
+    const __m128 diskRadius2 = _mm_set1_ps(params.diskRadius2);
+    const __m128 gravity = _mm_set1_ps(params.gravity);
+    const __m128 pinX = _mm_set1_ps(params.pin[0]);
+    const __m128 pinY = _mm_set1_ps(params.pin[1]);
+    const __m128 pinZ = _mm_set1_ps(params.pin[2]);
+    const __m128 pinPrevX = _mm_set1_ps(params.pinPrev[0]);
+    const __m128 pinPrevY = _mm_set1_ps(params.pinPrev[1]);
+    const __m128 pinPrevZ = _mm_set1_ps(params.pinPrev[2]);
+    const __m128 hitRadius2 = _mm_set1_ps(params.hitRadius2);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 minusOne = _mm_set1_ps(-1.0f);
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+
+    int hits = 0;
+    int i = 0;
+    for (; i + 4 <= span.count; i += 4) {
+        // ステップの始めのピンから見た位置
+        const __m128 d0x = _mm_sub_ps(_mm_loadu_ps(span.posX + i), pinPrevX);
+        const __m128 d0y = _mm_sub_ps(_mm_loadu_ps(span.posY + i), pinPrevY);
+        const __m128 d0z = _mm_sub_ps(_mm_loadu_ps(span.posZ + i), pinPrevZ);
+
+        const __m128 run = _mm_add_ps(_mm_loadu_ps(span.run + i), speed);
+        _mm_storeu_ps(span.run + i, run);
+        _mm_storeu_ps(span.spin + i, _mm_sub_ps(_mm_loadu_ps(span.spin + i), spinStep));
+
+        const __m128 rest = _mm_sub_ps(one, run);
+        const __m128 posX = _mm_add_ps(_mm_mul_ps(run, _mm_loadu_ps(span.goalX + i)),
+                                       _mm_mul_ps(rest, _mm_loadu_ps(span.startX + i)));
+        const __m128 posZ = _mm_add_ps(_mm_mul_ps(run, _mm_loadu_ps(span.goalZ + i)),
+                                       _mm_mul_ps(rest, _mm_loadu_ps(span.startZ + i)));
+        _mm_storeu_ps(span.posX + i, posX);
+        _mm_storeu_ps(span.posZ + i, posZ);
+
+        // 円盤の外に出たものだけ落下させる
+        const __m128 r2 = _mm_add_ps(_mm_mul_ps(posX, posX), _mm_mul_ps(posZ, posZ));
+        const __m128 off = _mm_cmpge_ps(r2, diskRadius2);
+        __m128 speedY = _mm_loadu_ps(span.speedY + i);
+        __m128 posY = _mm_loadu_ps(span.posY + i);
+        speedY = _mm_blendv_ps(speedY, _mm_add_ps(speedY, gravity), off);
+        posY = _mm_blendv_ps(posY, _mm_sub_ps(posY, speedY), off);
+        _mm_storeu_ps(span.speedY + i, speedY);
+        _mm_storeu_ps(span.posY + i, posY);
+
+        // 当たり判定 (sweptImpact() と同じ順序で計算する)
+        const __m128 d1x = _mm_sub_ps(posX, pinX);
+        const __m128 d1y = _mm_sub_ps(posY, pinY);
+        const __m128 d1z = _mm_sub_ps(posZ, pinZ);
+        const __m128 ex = _mm_sub_ps(d1x, d0x);
+        const __m128 ey = _mm_sub_ps(d1y, d0y);
+        const __m128 ez = _mm_sub_ps(d1z, d0z);
+        const __m128 a = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez));
+        const __m128 b = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0x, ex), _mm_mul_ps(d0y, ey)), _mm_mul_ps(d0z, ez));
+        const __m128 c0 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d0x, d0x), _mm_mul_ps(d0y, d0y)), _mm_mul_ps(d0z, d0z));
+        const __m128 c1 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d1x, d1x), _mm_mul_ps(d1y, d1y)), _mm_mul_ps(d1z, d1z));
+        const __m128 disc = _mm_sub_ps(_mm_mul_ps(b, b), _mm_mul_ps(a, _mm_sub_ps(c0, hitRadius2)));
+        const __m128 s = _mm_div_ps(_mm_sub_ps(_mm_xor_ps(b, signBit), _mm_sqrt_ps(_mm_max_ps(disc, zero))), a);
+        const __m128 swept = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(disc, zero), _mm_cmplt_ps(b, zero)), _mm_cmple_ps(s, one));
+        __m128 impact = _mm_blendv_ps(minusOne, one, _mm_cmple_ps(c1, hitRadius2));
+        impact = _mm_blendv_ps(impact, s, swept);
+        impact = _mm_blendv_ps(impact, zero, _mm_cmple_ps(c0, hitRadius2));
+        _mm_storeu_ps(span.impact + i, impact);
+        int mask = _mm_movemask_ps(_mm_cmpge_ps(impact, zero));
+        for (; mask != 0; mask &= mask - 1) {
+            hits++;
+        }
+    }
+
+    BallSpan tail = span;
+    tail.run += i;
+    tail.speedY += i;
+    tail.posX += i;
+    tail.posY += i;
+    tail.posZ += i;
+    tail.startX += i;
+    tail.startZ += i;
+    tail.goalX += i;
+    tail.goalZ += i;
+    tail.spin += i;
+    tail.impact += i;
+    tail.count -= i;
+    return hits + integrateBallsScalar(tail, params);
+}
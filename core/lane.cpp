@@ -0,0 +1,229 @@
+#include "lane.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const float PI = 4.0 * std::atan(1.0);
+
+const float BALL_SPEEDS[NUM_BALL_SPEEDS] = {0.03f, 0.06f, 0.09f, 0.12f, 0.18f, 0.36f, 0.9f, 1.8f, 3.9f, 6.0f};
+
+
+Lane::Lane()
+: config_() {
+    setIntegrator(bestIntegrator());
+    reserveBalls();
+    reset();
+}
+
+Lane::Lane(const LaneConfig &config)
+: config_(config) {
+    setIntegrator(bestIntegrator());
+    reserveBalls();
+    reset();
+}
+
+void Lane::reserveBalls() {
+    // 生きているボールの2倍の領域があれば, 投げるときは詰め直すだけで確保し直さない
+    balls_.reserve(2 * std::max(config_.ballBudget, config_.maxBalls));
+}
+
+void Lane::reset() {
+    tick_ = 0;
+    theta_ = 0.0f;
+    speedIndex_ = 5;
+    lastSpeed_ = 0.0f;
+    throwing_ = false;
+    hit_ = false;
+    balls_.clear();
+}
+
+void Lane::setIntegrator(IntegratorKind kind) {
+    integrator_ = integratorSupported(kind) ? kind : INTEGRATOR_SCALAR;
+    integrate_ = integratorFunc(integrator_);
+}
+
+void Lane::setTheta(float theta) {
+    theta_ = theta - 2.0f * PI * std::floor(theta / (2.0f * PI));
+}
+
+void Lane::setSpeedIndex(int speedIndex) {
+    speedIndex_ = std::max(0, std::min(speedIndex, NUM_BALL_SPEEDS - 1));
+}
+
+bool Lane::throwBall(float arrowAngle, BallHandle *handle) {
+    throwing_ = true;
+    if (config_.maxBalls > 0 && balls_.size() >= config_.maxBalls) {
+        return false;
+    }
+
+    const float r = config_.releaseRadius;
+    const float goalAngle = theta_ - (PI - 2.0f * arrowAngle);
+
+    const BallHandle h = balls_.push();
+    const int i = balls_.size() - 1;
+    balls_.run()[i] = 0.0f;
+    balls_.speedY()[i] = 0.0f;
+    balls_.startX()[i] = r * std::sin(theta_);
+    balls_.startZ()[i] = r * std::cos(theta_);
+    balls_.goalX()[i] = r * std::sin(goalAngle);
+    balls_.goalZ()[i] = r * std::cos(goalAngle);
+    balls_.posX()[i] = balls_.startX()[i];
+    balls_.posY()[i] = config_.releaseHeight;
+    balls_.posZ()[i] = balls_.startZ()[i];
+    balls_.spin()[i] = 0.0f;
+    balls_.impact()[i] = -1.0f;
+    balls_.axisX()[i] = std::sin(theta_) / 2.0f;
+    balls_.axisZ()[i] = std::cos(theta_) / 2.0f;
+
+    // 円盤の座標系では, 投げる位置も終点も投げたときの円盤の角度によらない.
+    // 慣性系で直線を進む速度から, 円盤の回転による分を引く.
+    const float speed = BALL_SPEEDS[speedIndex_];
+    balls_.localX()[i] = 0.0f;
+    balls_.localZ()[i] = r;
+    balls_.velX()[i] = speed * (-r * std::sin(2.0f * arrowAngle)) - config_.omega * r;
+    balls_.velZ()[i] = speed * (-r * std::cos(2.0f * arrowAngle) - r);
+
+    if (handle) {
+        *handle = h;
+    }
+    return true;
+}
+
+static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t k = 0; k < size; k++) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+// 列は 4バイトずつまとめて混ぜる (ボールが多いと毎ステップ数十KBになるので)
+static uint64_t hashWords(uint64_t hash, const float *data, int count) {
+    const uint32_t *words = (const uint32_t *)data;
+    for (int k = 0; k < count; k++) {
+        hash = (hash ^ words[k]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+uint64_t Lane::checksum() const {
+    uint64_t hash = 14695981039346656037ull;
+    const int numBalls = balls_.size();
+    const BallHandle first = numBalls > 0 ? balls_.handleAt(0) : balls_.nextHandle();
+    const unsigned char flags = (throwing_ ? 1 : 0) | (hit_ ? 2 : 0);
+    hash = hashBytes(hash, &tick_, sizeof(tick_));
+    hash = hashBytes(hash, &theta_, sizeof(theta_));
+    hash = hashBytes(hash, &speedIndex_, sizeof(speedIndex_));
+    hash = hashBytes(hash, &lastSpeed_, sizeof(lastSpeed_));
+    hash = hashBytes(hash, &flags, sizeof(flags));
+    hash = hashBytes(hash, &numBalls, sizeof(numBalls));
+    hash = hashBytes(hash, &first, sizeof(first));
+    for (int c = 0; c < BallStore::NUM_COLUMNS; c++) {
+        hash = hashWords(hash, balls_.column((BallStore::Column)c), numBalls);
+    }
+    return hash;
+}
+
+void Lane::pinPosition(float pos[3]) const {
+    pos[0] = -config_.pinRadius * std::sin(theta_);
+    pos[1] = config_.pinHeight;
+    pos[2] = -config_.pinRadius * std::cos(theta_);
+}
+
+void Lane::step() {
+    const float dt = config_.dt;
+    float pinPrev[3];
+    pinPosition(pinPrev);
+    tick_++;
+    theta_ += config_.omega * dt;
+    if (theta_ >= 2.0f * PI) {
+        theta_ -= 2.0f * PI;
+    }
+    if (!throwing_) {
+        return;
+    }
+
+    if (config_.dynamics != DYNAMICS_CHORD) {
+        stepRotating();
+        return;
+    }
+
+    // ボールを進めながら当たり判定もする
+    // (speedY は1ステップあたりの落下量として持つので, 重力は dt^2 倍して渡す)
+    IntegrateParams params;
+    params.speed = BALL_SPEEDS[speedIndex_] * dt;
+    params.spinStep = config_.spinRate * dt;
+    params.diskRadius2 = config_.diskRadius * config_.diskRadius;
+    params.gravity = config_.gravity * dt * dt;
+    pinPosition(params.pin);
+    params.pinPrev[0] = pinPrev[0];
+    params.pinPrev[1] = pinPrev[1];
+    params.pinPrev[2] = pinPrev[2];
+    params.hitRadius2 = config_.hitRadius * config_.hitRadius;
+    hit_ = integrate_(ballSpan(balls_), params) > 0;
+    lastSpeed_ = params.speed;
+
+    // 落ちきったボールを古い方から消す
+    while (!balls_.empty() && balls_.posY()[0] <= config_.dropHeight) {
+        balls_.popFront();
+    }
+}
+
+void Lane::stepRotating() {
+    const float dt = config_.dt;
+    RotatingParams params;
+    params.omega = config_.omega;
+    params.dt = dt;
+    params.spinStep = config_.spinRate * dt;
+    params.diskRadius2 = config_.diskRadius * config_.diskRadius;
+    params.gravity = config_.gravity * dt * dt;
+    params.cosTheta = std::cos(theta_);
+    params.sinTheta = std::sin(theta_);
+    params.pin[0] = 0.0f;
+    params.pin[1] = config_.pinHeight;
+    params.pin[2] = -config_.pinRadius;
+    params.hitRadius2 = config_.hitRadius * config_.hitRadius;
+
+    const int hits = config_.dynamics == DYNAMICS_RK4 ? stepRotatingRK4(balls_, params)
+                                                       : stepRotatingEuler(balls_, params);
+    hit_ = hits > 0;
+
+    // ボールごとに速さが違い, 投げた順に落ちるとは限らないので, 途中のボールも消す
+    balls_.removeBelow(BallStore::POS_Y, config_.dropHeight);
+}
+
+double Lane::impactTime(int i) const {
+    const float impact = balls_.impact()[i];
+    if (impact < 0.0f) {
+        return -1.0;
+    }
+    return ((double)(tick_ - 1) + impact) * config_.dt;
+}
+
+float Lane::renderTheta(float alpha) const {
+    return theta_ - (1.0f - alpha) * config_.omega * config_.dt;
+}
+
+void Lane::renderBallPosition(int i, float alpha, float pos[3]) const {
+    if (config_.dynamics != DYNAMICS_CHORD) {
+        // 円盤の座標系で速度の分だけ戻してから慣性系に回す
+        const float back = (1.0f - alpha) * config_.dt;
+        const float theta = renderTheta(alpha);
+        const float x = balls_.localX()[i] - back * balls_.velX()[i];
+        const float z = balls_.localZ()[i] - back * balls_.velZ()[i];
+        pos[0] = std::cos(theta) * x + std::sin(theta) * z;
+        pos[1] = balls_.posY()[i] + (1.0f - alpha) * balls_.speedY()[i];
+        pos[2] = -std::sin(theta) * x + std::cos(theta) * z;
+        return;
+    }
+
+    // 直線上の位置は run から, 高さは直前の落下量から1ステップ前の値を求める
+    const float run = std::max(0.0f, balls_.run()[i] - (1.0f - alpha) * lastSpeed_);
+    pos[0] = run * balls_.goalX()[i] + (1.0f - run) * balls_.startX()[i];
+    pos[1] = balls_.posY()[i] + (1.0f - alpha) * balls_.speedY()[i];
+    pos[2] = run * balls_.goalZ()[i] + (1.0f - run) * balls_.startZ()[i];
+}
+
+float Lane::renderBallSpin(int i, float alpha) const {
+    return std::min(0.0f, balls_.spin()[i] + (1.0f - alpha) * config_.spinRate * config_.dt);
+}
@@ -0,0 +1,114 @@
+#ifndef _CORIOLIS_LANE_H_
+#define _CORIOLIS_LANE_H_
+
+#include "ball_store.h"
+#include "integrator.h"
+#include "rotating_frame.h"
+
+// 回転円盤レーンのシミュレーション (OpenGL/GLFW には依存しない)
+
+// ボールの速さ (1秒あたりの run の増分)
+static const int NUM_BALL_SPEEDS = 10;
+extern const float BALL_SPEEDS[NUM_BALL_SPEEDS];
+
+struct LaneConfig {
+    LaneConfig()
+    : diskRadius(1.0f)
+    , releaseRadius(0.75f)
+    , releaseHeight(0.15f)
+    , pinRadius(0.9f)
+    , pinHeight(0.1f)
+    , hitRadius(0.08f)
+    , gravity(1.8f)
+    , dropHeight(-5.0f)
+    , omega(3.14159265358979f / 3.0f)
+    , spinRate(4.0f * 3.14159265358979f / 3.0f)
+    , dt(1.0f / 60.0f)
+    , dynamics(DYNAMICS_CHORD)
+    , ballBudget(1024)
+    , maxBalls(0) {
+    }
+
+    float diskRadius;       // 円盤の半径 (これより外に出たボールは落下する)
+    float releaseRadius;    // ボールを投げる位置の半径
+    float releaseHeight;    // ボールを投げる高さ
+    float pinRadius;        // ピンの位置の半径
+    float pinHeight;        // ピンの高さ
+    float hitRadius;        // 当たり判定の距離
+    float gravity;          // 重力加速度
+    float dropHeight;       // この高さまで落ちたボールを消す
+    float omega;            // 円盤の角速度 [rad/s]
+    float spinRate;         // ボール自身の回転の角速度 [rad/s]
+    float dt;               // 1ステップの時間 [s]
+    Dynamics dynamics;      // ボールの運動の計算方法
+    int ballBudget;         // 前もって領域を確保しておくボールの数
+    int maxBalls;           // 同時に転がせるボールの数 (0 なら無制限)
+};
+
+class Lane {
+public:
+    Lane();
+    explicit Lane(const LaneConfig &config);
+
+    void reset();
+
+    // 現在の円盤の角度からボールを投げる (maxBalls に達していれば false)
+    bool throwBall(float arrowAngle, BallHandle *handle = NULL);
+
+    // シミュレーションを dt だけ進める
+    void step();
+
+    // ボールを進めるカーネルを選ぶ (既定では CPU で使える一番速いもの)
+    void setIntegrator(IntegratorKind kind);
+    IntegratorKind integrator() const { return integrator_; }
+
+    // 円盤の角速度を変える (回転座標系で積分しているときはボールにかかる力も変わる)
+    void setOmega(float omega) { config_.omega = omega; }
+
+    // 円盤の角度を直接決める (決まった角度から投げるときに使う)
+    void setTheta(float theta);
+
+    void setSpeedIndex(int speedIndex);
+    int speedIndex() const { return speedIndex_; }
+
+    const LaneConfig &config() const { return config_; }
+    unsigned long long tick() const { return tick_; }
+    float theta() const { return theta_; }
+    bool throwing() const { return throwing_; }
+    bool hit() const { return hit_; }
+
+    // ボール i が直前のステップでピンに当たった時刻 [s] (当たっていなければ負の値)
+    double impactTime(int i) const;
+
+    int numBalls() const { return balls_.size(); }
+    const BallStore &balls() const { return balls_; }
+
+    // 状態をビット単位でまとめたハッシュ (FNV-1a).
+    // 同じ入力から違う値になったら, どこかの計算が非決定的になっている.
+    uint64_t checksum() const;
+
+    // 現在のピンの位置
+    void pinPosition(float pos[3]) const;
+
+    // 直前の2ステップの間を alpha [0, 1] で補間した描画用の値
+    float renderTheta(float alpha) const;
+    void renderBallPosition(int i, float alpha, float pos[3]) const;
+    float renderBallSpin(int i, float alpha) const;
+
+private:
+    void reserveBalls();
+    void stepRotating();
+
+    LaneConfig config_;
+    IntegratorKind integrator_;
+    IntegrateFunc integrate_;
+    unsigned long long tick_;
+    float theta_;
+    int speedIndex_;
+    float lastSpeed_;       // 直前のステップで使った run の増分
+    bool throwing_;
+    bool hit_;
+    BallStore balls_;
+};
+
+#endif  // _CORIOLIS_LANE_H_
@@ -0,0 +1,249 @@
+#include "mesh_data.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+namespace {
+
+// 頂点のビット列をそのままキーにする (-0 と +0 は別の頂点になるが, 同じ OBJ の値なら一致する)
+struct VertexHash {
+    size_t operator()(const MeshVertex &v) const {
+        const unsigned char *bytes = (const unsigned char *)&v;
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t k = 0; k < sizeof(MeshVertex); k++) {
+            hash = (hash ^ bytes[k]) * 1099511628211ull;
+        }
+        return (size_t)hash;
+    }
+};
+
+struct VertexEqual {
+    bool operator()(const MeshVertex &a, const MeshVertex &b) const {
+        return memcmp(&a, &b, sizeof(MeshVertex)) == 0;
+    }
+};
+
+const float POSITION_TOLERANCE = 1.0e-4f;
+const float TEXCOORD_TOLERANCE = 1.0f / 8192.0f;
+
+// [-1, 1] の値を n ビットの符号付き正規化整数にする (戻すときは max(q / (2^(n-1) - 1), -1))
+int quantizeSnorm(float value, int bits) {
+    const float scale = (float)((1 << (bits - 1)) - 1);
+    const float clamped = std::max(-1.0f, std::min(value, 1.0f));
+    return (int)std::floor(clamped * scale + 0.5f);
+}
+
+// [0, 1] の値を n ビットの符号なし正規化整数にする
+int quantizeUnorm(float value, int bits) {
+    const float scale = (float)((1 << bits) - 1);
+    const float clamped = std::max(0.0f, std::min(value, 1.0f));
+    return (int)std::floor(clamped * scale + 0.5f);
+}
+
+}  // namespace
+
+VertexQuantization::VertexQuantization()
+: positionError(0.0f)
+, texcoordError(0.0f) {
+    for (int k = 0; k < 3; k++) {
+        positionOffset[k] = 0.0f;
+        positionScale[k] = 1.0f;
+    }
+    for (int k = 0; k < 2; k++) {
+        texcoordOffset[k] = 0.0f;
+        texcoordScale[k] = 1.0f;
+    }
+}
+
+std::vector<uint16_t> MeshData::shortIndices() const {
+    return std::vector<uint16_t>(indices.begin(), indices.end());
+}
+
+bool loadMeshData(const std::string &filename, MeshData *mesh, std::string *err) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, err, filename.c_str())) {
+        return false;
+    }
+
+    mesh->vertices.clear();
+    mesh->indices.clear();
+    mesh->lods.clear();
+    for (size_t s = 0; s < shapes.size(); s++) {
+        const tinyobj::mesh_t &shapeMesh = shapes[s].mesh;
+        for (size_t i = 0; i < shapeMesh.indices.size(); i++) {
+            const tinyobj::index_t &index = shapeMesh.indices[i];
+
+            MeshVertex vertex;
+            memset(&vertex, 0, sizeof(vertex));
+            if (index.vertex_index >= 0) {
+                for (int k = 0; k < 3; k++) {
+                    vertex.position[k] = attrib.vertices[index.vertex_index * 3 + k];
+                }
+            }
+            if (index.normal_index >= 0) {
+                for (int k = 0; k < 3; k++) {
+                    vertex.normal[k] = attrib.normals[index.normal_index * 3 + k];
+                }
+            }
+            if (index.texcoord_index >= 0) {
+                vertex.texcoord[0] = attrib.texcoords[index.texcoord_index * 2 + 0];
+                vertex.texcoord[1] = 1.0f - attrib.texcoords[index.texcoord_index * 2 + 1];
+            }
+
+            mesh->indices.push_back((uint32_t)mesh->vertices.size());
+            mesh->vertices.push_back(vertex);
+        }
+    }
+    mesh->numCorners = (int)mesh->vertices.size();
+
+    weldVertices(mesh);
+    return true;
+}
+
+void weldVertices(MeshData *mesh) {
+    std::unordered_map<MeshVertex, uint32_t, VertexHash, VertexEqual> welded;
+    welded.reserve(mesh->vertices.size());
+
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> remap(mesh->vertices.size());
+    for (size_t i = 0; i < mesh->vertices.size(); i++) {
+        const MeshVertex &vertex = mesh->vertices[i];
+        std::pair<std::unordered_map<MeshVertex, uint32_t, VertexHash, VertexEqual>::iterator, bool> result =
+                welded.insert(std::make_pair(vertex, (uint32_t)vertices.size()));
+        if (result.second) {
+            vertices.push_back(vertex);
+        }
+        remap[i] = result.first->second;
+    }
+
+    for (size_t i = 0; i < mesh->indices.size(); i++) {
+        mesh->indices[i] = remap[mesh->indices[i]];
+    }
+    mesh->vertices.swap(vertices);
+}
+
+bool packVertices(const MeshData &mesh, std::vector<PackedVertex> *packed, VertexQuantization *quantization) {
+    *quantization = VertexQuantization();
+    packed->resize(mesh.vertices.size());
+    if (mesh.vertices.empty()) {
+        return true;
+    }
+
+    // 位置はバウンディングボックスの中心からの [-1, 1], テクスチャ座標は範囲の中の [0, 1] にする
+    float lower[5], upper[5];
+    for (int k = 0; k < 5; k++) {
+        lower[k] = upper[k] = k < 3 ? mesh.vertices[0].position[k] : mesh.vertices[0].texcoord[k - 3];
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const MeshVertex &v = mesh.vertices[i];
+        for (int k = 0; k < 5; k++) {
+            const float value = k < 3 ? v.position[k] : v.texcoord[k - 3];
+            lower[k] = std::min(lower[k], value);
+            upper[k] = std::max(upper[k], value);
+        }
+    }
+    float diagonal = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        const float halfExtent = 0.5f * (upper[k] - lower[k]);
+        quantization->positionOffset[k] = 0.5f * (upper[k] + lower[k]);
+        quantization->positionScale[k] = halfExtent > 0.0f ? halfExtent : 1.0f;
+        diagonal += 4.0f * halfExtent * halfExtent;
+    }
+    diagonal = std::sqrt(diagonal);
+    for (int k = 0; k < 2; k++) {
+        const float extent = upper[k + 3] - lower[k + 3];
+        quantization->texcoordOffset[k] = lower[k + 3];
+        quantization->texcoordScale[k] = extent > 0.0f ? extent : 1.0f;
+    }
+
+    float positionError = 0.0f;
+    float texcoordError = 0.0f;
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        const MeshVertex &v = mesh.vertices[i];
+        PackedVertex &p = (*packed)[i];
+
+        float errorSquared = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            const float offset = quantization->positionOffset[k];
+            const float scale = quantization->positionScale[k];
+            const int q = quantizeSnorm((v.position[k] - offset) / scale, 16);
+            p.position[k] = (int16_t)q;
+            const float restored = offset + scale * std::max(q / 32767.0f, -1.0f);
+            errorSquared += (restored - v.position[k]) * (restored - v.position[k]);
+        }
+        p.position[3] = 0;
+        positionError = std::max(positionError, std::sqrt(errorSquared));
+
+        // 法線は x, y, z を 10 ビットずつ下から詰める
+        const float length = std::sqrt(v.normal[0] * v.normal[0] + v.normal[1] * v.normal[1] + v.normal[2] * v.normal[2]);
+        uint32_t normal = 0;
+        for (int k = 0; k < 3; k++) {
+            const int q = quantizeSnorm(length > 0.0f ? v.normal[k] / length : 0.0f, 10);
+            normal |= ((uint32_t)q & 0x3ffu) << (10 * k);
+        }
+        p.normal = normal;
+
+        for (int k = 0; k < 2; k++) {
+            const float offset = quantization->texcoordOffset[k];
+            const float scale = quantization->texcoordScale[k];
+            const int q = quantizeUnorm((v.texcoord[k] - offset) / scale, 16);
+            p.texcoord[k] = (uint16_t)q;
+            const float restored = offset + scale * (q / 65535.0f);
+            texcoordError = std::max(texcoordError, std::fabs(restored - v.texcoord[k]));
+        }
+    }
+
+    quantization->positionError = diagonal > 0.0f ? positionError / diagonal : 0.0f;
+    quantization->texcoordError = texcoordError;
+    return quantization->positionError <= POSITION_TOLERANCE && quantization->texcoordError <= TEXCOORD_TOLERANCE;
+}
+
+MeshBounds computeBounds(const MeshData &mesh) {
+    MeshBounds bounds;
+    for (int k = 0; k < 3; k++) {
+        bounds.min[k] = mesh.vertices.empty() ? 0.0f : mesh.vertices[0].position[k];
+        bounds.max[k] = bounds.min[k];
+    }
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        for (int k = 0; k < 3; k++) {
+            bounds.min[k] = std::min(bounds.min[k], mesh.vertices[i].position[k]);
+            bounds.max[k] = std::max(bounds.max[k], mesh.vertices[i].position[k]);
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        bounds.center[k] = 0.5f * (bounds.min[k] + bounds.max[k]);
+    }
+
+    float radius2 = 0.0f;
+    for (size_t i = 0; i < mesh.vertices.size(); i++) {
+        float d2 = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            const float d = mesh.vertices[i].position[k] - bounds.center[k];
+            d2 += d * d;
+        }
+        radius2 = std::max(radius2, d2);
+    }
+    bounds.radius = std::sqrt(radius2);
+    return bounds;
+}
+
+std::string meshReport(const std::string &name, const MeshData &mesh) {
+    const size_t before = mesh.unweldedVertexBytes() + mesh.unweldedIndexBytes();
+    const size_t after = mesh.vertexBytes() + mesh.indexBytes();
+    char line[512];
+    snprintf(line, sizeof(line),
+             "%s: %d -> %d vertices, vertex %zu -> %zu bytes, index %zu -> %zu bytes (%d-bit), %.1f%% saved",
+             name.c_str(), mesh.numCorners, (int)mesh.vertices.size(),
+             mesh.unweldedVertexBytes(), mesh.vertexBytes(),
+             mesh.unweldedIndexBytes(), mesh.indexBytes(), (int)mesh.indexSize() * 8,
+             before > 0 ? 100.0 * (1.0 - (double)after / before) : 0.0);
+    return line;
+}
@@ -0,0 +1,94 @@
+#ifndef _CORIOLIS_MESH_DATA_H_
+#define _CORIOLIS_MESH_DATA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// OBJ ファイルから読み込んだ, GPU に送る前のメッシュ (OpenGL には依存しない).
+// 面の角ごとに頂点を作らず, 位置・法線・テクスチャ座標がすべて同じ角は1つの頂点にまとめる.
+
+// 頂点の並び (main.cpp の頂点属性 0〜2 と同じ)
+struct MeshVertex {
+    float position[3];
+    float normal[3];
+    float texcoord[2];
+};
+
+// 詰めた頂点の並び (16 バイト).
+//   位置         バウンディングボックスに対する snorm16 (4つ目は使わない)
+//   法線         GL_INT_2_10_10_10_REV の snorm
+//   テクスチャ座標 座標の範囲に対する unorm16
+struct PackedVertex {
+    int16_t position[4];
+    uint32_t normal;
+    uint16_t texcoord[2];
+};
+
+// 詰めた値から元の値に戻すための係数 (シェーダでは offset + scale * 正規化した値).
+// 詰めていないメッシュでは offset = 0, scale = 1 にしておけば同じシェーダで描ける.
+struct VertexQuantization {
+    float positionOffset[3];
+    float positionScale[3];
+    float texcoordOffset[2];
+    float texcoordScale[2];
+    float positionError;        // 戻したときの位置の誤差の最大値 (バウンディングボックスの対角線に対する比)
+    float texcoordError;        // 戻したときのテクスチャ座標の誤差の最大値
+
+    VertexQuantization();
+};
+
+// LOD 1つ分のインデックスの範囲と, 元の面からのずれ (メッシュの座標での距離)
+struct MeshLod {
+    uint32_t firstIndex;
+    uint32_t indexCount;
+    float error;
+};
+
+// メッシュの座標での境界. 球の中心は箱の中心にとる
+struct MeshBounds {
+    float min[3];
+    float max[3];
+    float center[3];
+    float radius;
+};
+
+struct MeshData {
+    std::vector<MeshVertex> vertices;
+    std::vector<uint32_t> indices;  // LOD があれば, すべての LOD のインデックスを細かい順に並べたもの
+    std::vector<MeshLod> lods;      // 空なら indices 全体が1つのメッシュ
+    int numCorners;                 // まとめる前の頂点の数 (= 面の角の数)
+
+    // インデックスが 16 ビットに収まるか
+    bool fitsShortIndices() const { return vertices.size() <= 65536; }
+    size_t indexSize() const { return fitsShortIndices() ? sizeof(uint16_t) : sizeof(uint32_t); }
+
+    size_t vertexBytes() const { return vertices.size() * sizeof(MeshVertex); }
+    size_t indexBytes() const { return indices.size() * indexSize(); }
+
+    // まとめる前 (角ごとに頂点を作り, 32 ビットのインデックスを使っていたとき) のバイト数
+    size_t unweldedVertexBytes() const { return (size_t)numCorners * sizeof(MeshVertex); }
+    size_t unweldedIndexBytes() const { return (size_t)numCorners * sizeof(uint32_t); }
+
+    std::vector<uint16_t> shortIndices() const;
+};
+
+// OBJ ファイルを読み込み, 同じ頂点をまとめる (読み込めなければ false と err にメッセージ).
+// テクスチャ座標の v は OpenGL に合わせて反転する.
+bool loadMeshData(const std::string &filename, MeshData *mesh, std::string *err);
+
+// 同じ頂点をまとめ, インデックスをまとめた頂点の番号に付け替える
+void weldVertices(MeshData *mesh);
+
+// 頂点を PackedVertex に詰める. 誤差が許せる範囲 (位置は対角線の 1e-4, テクスチャ座標は 1/8192) に
+// 収まれば true を返すので, そのときだけ詰めた頂点を使う.
+bool packVertices(const MeshData &mesh, std::vector<PackedVertex> *packed, VertexQuantization *quantization);
+
+// すべての頂点を囲む箱と球
+MeshBounds computeBounds(const MeshData &mesh);
+
+// 読み込んだときに出す1行のまとめ (頂点とインデックスのバイト数がどれだけ減ったか)
+std::string meshReport(const std::string &name, const MeshData &mesh);
+
+#endif  // _CORIOLIS_MESH_DATA_H_
@@ -0,0 +1,264 @@
+#include "mesh_optimize.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Forsyth の方法で三角形を選ぶときのキャッシュの大きさと重み
+const int SCORE_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+// キャッシュの中の位置 (入っていなければ -1) と, まだ描いていない三角形の数から頂点の点数を決める
+float vertexScore(int cachePosition, int remaining) {
+    if (remaining == 0) {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        // 直前の三角形の頂点は, 次の三角形でまたすぐ使うとは限らないので少し下げる
+        if (cachePosition < 3) {
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            const float scale = 1.0f / (SCORE_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    // 残りの三角形が少ない頂点を先に片付ける
+    score += VALENCE_BOOST_SCALE * std::pow((float)remaining, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+}  // namespace
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t numVertices, int cacheSize) {
+    if (indices.empty()) {
+        return 0.0f;
+    }
+
+    // 頂点ごとにキャッシュに入った時刻を覚えておけば, FIFO の中身を持たなくてよい
+    std::vector<long long> insertedAt(numVertices, -(long long)cacheSize - 1);
+    long long time = 0;
+    int misses = 0;
+    for (size_t i = 0; i < indices.size(); i++) {
+        const uint32_t v = indices[i];
+        if (time - insertedAt[v] >= cacheSize) {
+            insertedAt[v] = ++time;
+            misses++;
+        }
+    }
+    return (float)misses / (indices.size() / 3);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> *indices, size_t numVertices) {
+    std::vector<uint32_t> &input = *indices;
+    const size_t numTriangles = input.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // 頂点ごとに, その頂点を使う三角形の並び (描いた三角形は後ろに追い出して数を減らす)
+    std::vector<uint32_t> offsets(numVertices + 1, 0);
+    for (size_t i = 0; i < input.size(); i++) {
+        offsets[input[i] + 1]++;
+    }
+    for (size_t v = 0; v < numVertices; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(input.size());
+    std::vector<int> remaining(numVertices, 0);
+    for (size_t t = 0; t < numTriangles; t++) {
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = input[t * 3 + k];
+            adjacency[offsets[v] + remaining[v]++] = (uint32_t)t;
+        }
+    }
+
+    std::vector<int> cachePosition(numVertices, -1);
+    std::vector<float> score(numVertices);
+    for (size_t v = 0; v < numVertices; v++) {
+        score[v] = vertexScore(-1, remaining[v]);
+    }
+    std::vector<float> triangleScore(numTriangles);
+    for (size_t t = 0; t < numTriangles; t++) {
+        triangleScore[t] = score[input[t * 3 + 0]] + score[input[t * 3 + 1]] + score[input[t * 3 + 2]];
+    }
+
+    std::vector<bool> emitted(numTriangles, false);
+    std::vector<uint32_t> output;
+    output.reserve(input.size());
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(SCORE_CACHE_SIZE + 3);
+    nextCache.reserve(SCORE_CACHE_SIZE + 3);
+
+    size_t cursor = 0;
+    int best = -1;
+    while (output.size() < input.size()) {
+        // キャッシュの頂点から続けられなければ, まだ描いていない三角形を元の順に探す
+        if (best < 0) {
+            while (emitted[cursor]) {
+                cursor++;
+            }
+            best = (int)cursor;
+        }
+
+        const uint32_t *triangle = &input[best * 3];
+        emitted[best] = true;
+        nextCache.assign(triangle, triangle + 3);
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = triangle[k];
+            output.push_back(v);
+
+            uint32_t *list = &adjacency[offsets[v]];
+            for (int j = 0; j < remaining[v]; j++) {
+                if (list[j] == (uint32_t)best) {
+                    std::swap(list[j], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+        for (size_t c = 0; c < cache.size(); c++) {
+            if (cache[c] != triangle[0] && cache[c] != triangle[1] && cache[c] != triangle[2]) {
+                nextCache.push_back(cache[c]);
+            }
+        }
+        cache.swap(nextCache);
+
+        // 頂点の点数が変わった分を, その頂点を使う三角形の点数に足す
+        for (size_t c = 0; c < cache.size(); c++) {
+            const uint32_t v = cache[c];
+            const int position = c < SCORE_CACHE_SIZE ? (int)c : -1;
+            cachePosition[v] = position;
+            const float newScore = vertexScore(position, remaining[v]);
+            const float delta = newScore - score[v];
+            score[v] = newScore;
+            for (int j = 0; j < remaining[v]; j++) {
+                triangleScore[adjacency[offsets[v] + j]] += delta;
+            }
+        }
+        if (cache.size() > SCORE_CACHE_SIZE) {
+            cache.resize(SCORE_CACHE_SIZE);
+        }
+
+        // 次はキャッシュの頂点を使う三角形のうち点数の一番高いもの
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t c = 0; c < cache.size(); c++) {
+            const uint32_t v = cache[c];
+            for (int j = 0; j < remaining[v]; j++) {
+                const uint32_t t = adjacency[offsets[v] + j];
+                if (triangleScore[t] > bestScore) {
+                    bestScore = triangleScore[t];
+                    best = (int)t;
+                }
+            }
+        }
+    }
+
+    input.swap(output);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> *indices, const std::vector<MeshVertex> &vertices) {
+    std::vector<uint32_t> &input = *indices;
+    const size_t numTriangles = input.size() / 3;
+    if (numTriangles == 0) {
+        return;
+    }
+
+    // 3つとも外れる三角形でキャッシュは入れ替わるので, そこで区切れば塊の順を変えても ACMR はほとんど変わらない
+    std::vector<size_t> clusterStart;
+    std::vector<long long> insertedAt(vertices.size(), -(long long)VERTEX_CACHE_SIZE - 1);
+    long long time = 0;
+    for (size_t t = 0; t < numTriangles; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            const uint32_t v = input[t * 3 + k];
+            if (time - insertedAt[v] >= VERTEX_CACHE_SIZE) {
+                insertedAt[v] = ++time;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3) {
+            clusterStart.push_back(t);
+        }
+    }
+    clusterStart.push_back(numTriangles);
+    const size_t numClusters = clusterStart.size() - 1;
+
+    // 三角形の重心と面積をかけた法線
+    std::vector<float> centroid(numTriangles * 3);
+    std::vector<float> normal(numTriangles * 3);
+    float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+    for (size_t t = 0; t < numTriangles; t++) {
+        const float *p0 = vertices[input[t * 3 + 0]].position;
+        const float *p1 = vertices[input[t * 3 + 1]].position;
+        const float *p2 = vertices[input[t * 3 + 2]].position;
+        const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+        const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+        normal[t * 3 + 0] = e1[1] * e2[2] - e1[2] * e2[1];
+        normal[t * 3 + 1] = e1[2] * e2[0] - e1[0] * e2[2];
+        normal[t * 3 + 2] = e1[0] * e2[1] - e1[1] * e2[0];
+        for (int k = 0; k < 3; k++) {
+            centroid[t * 3 + k] = (p0[k] + p1[k] + p2[k]) / 3.0f;
+            meshCentroid[k] += centroid[t * 3 + k] / numTriangles;
+        }
+    }
+
+    // メッシュの中心から見て外を向いている塊ほど, 他の面を隠しやすいので先に描く
+    std::vector<std::pair<float, size_t> > order(numClusters);
+    for (size_t c = 0; c < numClusters; c++) {
+        float center[3] = { 0.0f, 0.0f, 0.0f };
+        float direction[3] = { 0.0f, 0.0f, 0.0f };
+        const size_t count = clusterStart[c + 1] - clusterStart[c];
+        for (size_t t = clusterStart[c]; t < clusterStart[c + 1]; t++) {
+            for (int k = 0; k < 3; k++) {
+                center[k] += centroid[t * 3 + k] / count;
+                direction[k] += normal[t * 3 + k];
+            }
+        }
+        const float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+        float facing = 0.0f;
+        if (length > 0.0f) {
+            for (int k = 0; k < 3; k++) {
+                facing += (center[k] - meshCentroid[k]) * direction[k] / length;
+            }
+        }
+        order[c] = std::make_pair(-facing, c);
+    }
+    std::stable_sort(order.begin(), order.end());
+
+    std::vector<uint32_t> output;
+    output.reserve(input.size());
+    for (size_t i = 0; i < numClusters; i++) {
+        const size_t c = order[i].second;
+        output.insert(output.end(), input.begin() + clusterStart[c] * 3, input.begin() + clusterStart[c + 1] * 3);
+    }
+    input.swap(output);
+}
+
+void optimizeVertexFetch(MeshData *mesh) {
+    static const uint32_t UNUSED = 0xffffffffu;
+    std::vector<uint32_t> remap(mesh->vertices.size(), UNUSED);
+    std::vector<MeshVertex> vertices;
+    vertices.reserve(mesh->vertices.size());
+    for (size_t i = 0; i < mesh->indices.size(); i++) {
+        uint32_t &index = mesh->indices[i];
+        if (remap[index] == UNUSED) {
+            remap[index] = (uint32_t)vertices.size();
+            vertices.push_back(mesh->vertices[index]);
+        }
+        index = remap[index];
+    }
+    mesh->vertices.swap(vertices);
+}
+
+void optimizeMesh(MeshData *mesh) {
+    optimizeVertexCache(&mesh->indices, mesh->vertices.size());
+    optimizeOverdraw(&mesh->indices, mesh->vertices);
+    optimizeVertexFetch(mesh);
+}
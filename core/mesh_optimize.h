@@ -0,0 +1,34 @@
+#ifndef _CORIOLIS_MESH_OPTIMIZE_H_
+#define _CORIOLIS_MESH_OPTIMIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.h"
+
+// 読み込んだメッシュの三角形と頂点の並べ替え (OpenGL には依存しない).
+// 頂点シェーダの結果のキャッシュに当たりやすく, 奥の面を手前の面より後に描きやすく,
+// 頂点バッファを前から順に読むように並べる. 描かれる三角形そのものは変えない.
+
+// ACMR を測るときのキャッシュの大きさ (FIFO)
+static const int VERTEX_CACHE_SIZE = 16;
+
+// 三角形1つあたりに頂点シェーダを実行する回数 (Average Cache Miss Ratio).
+// 1 に近いほどよく, キャッシュがなければ 3.
+float computeACMR(const std::vector<uint32_t> &indices, size_t numVertices, int cacheSize = VERTEX_CACHE_SIZE);
+
+// キャッシュに残っている頂点を使う三角形から順に描くように並べ替える (Forsyth の方法)
+void optimizeVertexCache(std::vector<uint32_t> *indices, size_t numVertices);
+
+// optimizeVertexCache の後で, キャッシュが切り替わるところで三角形を塊に分け,
+// 外を向いている塊から先に描くように塊を並べ替える (重ね描きを減らす)
+void optimizeOverdraw(std::vector<uint32_t> *indices, const std::vector<MeshVertex> &vertices);
+
+// 頂点を最初に使われる順に並べ直し, インデックスを付け替える (使われない頂点は捨てる)
+void optimizeVertexFetch(MeshData *mesh);
+
+// 上の3つを順にかける
+void optimizeMesh(MeshData *mesh);
+
+#endif  // _CORIOLIS_MESH_OPTIMIZE_H_
@@ -0,0 +1,358 @@
+#include "mesh_simplify.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "mesh_optimize.h"
+
+namespace {
+
+// 平面からの距離の2乗を面積で重み付けして足したもの (4x4 の対称行列の上半分と重みの合計)
+struct Quadric {
+    double q[10];   // xx xy xz xw yy yz yw zz zw ww
+    double weight;
+
+    Quadric() : weight(0.0) {
+        memset(q, 0, sizeof(q));
+    }
+
+    // 平面 n.x + d = 0 (n は単位ベクトル)
+    void addPlane(const double n[3], double d, double w) {
+        const double p[4] = { n[0], n[1], n[2], d };
+        int k = 0;
+        for (int i = 0; i < 4; i++) {
+            for (int j = i; j < 4; j++) {
+                q[k++] += w * p[i] * p[j];
+            }
+        }
+        weight += w;
+    }
+
+    void add(const Quadric &other) {
+        for (int k = 0; k < 10; k++) {
+            q[k] += other.q[k];
+        }
+        weight += other.weight;
+    }
+
+    // 点 v での面積あたりの距離の2乗
+    double evaluate(const float v[3]) const {
+        const double x = v[0], y = v[1], z = v[2];
+        const double e = q[0] * x * x + 2.0 * q[1] * x * y + 2.0 * q[2] * x * z + 2.0 * q[3] * x
+                       + q[4] * y * y + 2.0 * q[5] * y * z + 2.0 * q[6] * y
+                       + q[7] * z * z + 2.0 * q[8] * z
+                       + q[9];
+        return weight > 0.0 ? std::max(e, 0.0) / weight : 0.0;
+    }
+};
+
+struct Collapse {
+    double cost;
+    uint32_t from;      // 寄せる側の位置のグループ
+    uint32_t to;
+
+    bool operator<(const Collapse &other) const { return cost < other.cost; }
+};
+
+void cross(const float a[3], const float b[3], const float c[3], double n[3]) {
+    const double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    const double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// 縮めるたびに向きが大きく変わる三角形があれば, その辺は縮めない
+const double MIN_NORMAL_COSINE = 0.2;
+
+// 続けて呼ぶと, 前に減らしたところからさらに減らす
+class Simplifier {
+public:
+    Simplifier(const std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices);
+
+    void run(size_t targetIndexCount);
+
+    const std::vector<uint32_t> &indices() const { return indices_; }
+    float error() const { return (float)error_; }
+
+private:
+    const float *position(uint32_t group) const { return vertices_[groupVertices_[group][0]].position; }
+    bool flips(uint32_t from, uint32_t to, const uint32_t *triangles, uint32_t count) const;
+    uint32_t nearestVertex(uint32_t vertex, uint32_t group) const;
+
+    const std::vector<MeshVertex> &vertices_;
+    std::vector<uint32_t> indices_;
+    std::vector<uint32_t> group_;                           // 頂点 → 位置のグループ
+    std::vector<std::vector<uint32_t> > groupVertices_;     // 位置のグループ → 頂点
+    std::vector<Quadric> quadrics_;
+    std::vector<bool> locked_;                              // 穴の縁にあるグループ
+    double error_;
+};
+
+Simplifier::Simplifier(const std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices)
+: vertices_(vertices)
+, indices_(indices)
+, error_(0.0) {
+    // 位置だけでまとめる
+    std::map<std::vector<float>, uint32_t> groups;
+    group_.resize(vertices.size());
+    for (size_t v = 0; v < vertices.size(); v++) {
+        const std::vector<float> key(vertices[v].position, vertices[v].position + 3);
+        std::map<std::vector<float>, uint32_t>::iterator it = groups.find(key);
+        if (it == groups.end()) {
+            it = groups.insert(std::make_pair(key, (uint32_t)groupVertices_.size())).first;
+            groupVertices_.push_back(std::vector<uint32_t>());
+        }
+        group_[v] = it->second;
+        groupVertices_[it->second].push_back((uint32_t)v);
+    }
+    const size_t numGroups = groupVertices_.size();
+
+    quadrics_.resize(numGroups);
+    std::map<std::pair<uint32_t, uint32_t>, int> edgeCount;
+    for (size_t t = 0; t + 2 < indices_.size(); t += 3) {
+        const uint32_t g[3] = { group_[indices_[t]], group_[indices_[t + 1]], group_[indices_[t + 2]] };
+        double n[3];
+        cross(position(g[0]), position(g[1]), position(g[2]), n);
+        const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0) {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+            const float *p = position(g[0]);
+            const double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+            for (int k = 0; k < 3; k++) {
+                quadrics_[g[k]].addPlane(n, d, 0.5 * length);
+            }
+        }
+        for (int k = 0; k < 3; k++) {
+            const uint32_t a = g[k], b = g[(k + 1) % 3];
+            edgeCount[std::make_pair(std::min(a, b), std::max(a, b))]++;
+        }
+    }
+
+    // 1つの三角形にしか使われていない辺は穴の縁
+    locked_.assign(numGroups, false);
+    for (std::map<std::pair<uint32_t, uint32_t>, int>::const_iterator it = edgeCount.begin(); it != edgeCount.end(); ++it) {
+        if (it->second == 1) {
+            locked_[it->first.first] = true;
+            locked_[it->first.second] = true;
+        }
+    }
+}
+
+bool Simplifier::flips(uint32_t from, uint32_t to, const uint32_t *triangles, uint32_t count) const {
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t *tri = &indices_[triangles[i] * 3];
+        const float *p[3];
+        const float *q[3];
+        bool hasTo = false;
+        for (int k = 0; k < 3; k++) {
+            const uint32_t g = group_[tri[k]];
+            hasTo = hasTo || g == to;
+            p[k] = position(g);
+            q[k] = g == from ? position(to) : p[k];
+        }
+        // 縮める辺を含む三角形は消える
+        if (hasTo) {
+            continue;
+        }
+        double before[3], after[3];
+        cross(p[0], p[1], p[2], before);
+        cross(q[0], q[1], q[2], after);
+        const double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+        const double lengths = std::sqrt((before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                                         (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]));
+        if (dot <= MIN_NORMAL_COSINE * lengths) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// 寄せた先のグループの頂点のうち, 法線とテクスチャ座標が一番近いもの
+uint32_t Simplifier::nearestVertex(uint32_t vertex, uint32_t group) const {
+    const MeshVertex &v = vertices_[vertex];
+    const std::vector<uint32_t> &candidates = groupVertices_[group];
+    uint32_t best = candidates[0];
+    float bestDistance = 0.0f;
+    for (size_t c = 0; c < candidates.size(); c++) {
+        const MeshVertex &u = vertices_[candidates[c]];
+        float distance = 0.0f;
+        for (int k = 0; k < 3; k++) {
+            distance += (u.normal[k] - v.normal[k]) * (u.normal[k] - v.normal[k]);
+        }
+        for (int k = 0; k < 2; k++) {
+            distance += (u.texcoord[k] - v.texcoord[k]) * (u.texcoord[k] - v.texcoord[k]);
+        }
+        if (c == 0 || distance < bestDistance) {
+            best = candidates[c];
+            bestDistance = distance;
+        }
+    }
+    return best;
+}
+
+void Simplifier::run(size_t targetIndexCount) {
+    const size_t numGroups = groupVertices_.size();
+    while (indices_.size() > targetIndexCount) {
+        const size_t numTriangles = indices_.size() / 3;
+
+        // グループごとに, そのグループを使う三角形
+        std::vector<uint32_t> offsets(numGroups + 1, 0);
+        for (size_t i = 0; i < indices_.size(); i++) {
+            offsets[group_[indices_[i]] + 1]++;
+        }
+        for (size_t g = 0; g < numGroups; g++) {
+            offsets[g + 1] += offsets[g];
+        }
+        std::vector<uint32_t> adjacency(indices_.size());
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices_.size(); i++) {
+            adjacency[fill[group_[indices_[i]]]++] = (uint32_t)(i / 3);
+        }
+
+        // 辺ごとに, 安いほうの向きに縮めたときの誤差
+        std::vector<Collapse> collapses;
+        collapses.reserve(indices_.size());
+        for (size_t t = 0; t < numTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                const uint32_t a = group_[indices_[t * 3 + k]];
+                const uint32_t b = group_[indices_[t * 3 + (k + 1) % 3]];
+                if (a >= b) {
+                    continue;
+                }
+                Quadric q = quadrics_[a];
+                q.add(quadrics_[b]);
+                Collapse collapse;
+                collapse.cost = -1.0;
+                if (!locked_[a]) {
+                    collapse.cost = q.evaluate(position(b));
+                    collapse.from = a;
+                    collapse.to = b;
+                }
+                if (!locked_[b]) {
+                    const double cost = q.evaluate(position(a));
+                    if (collapse.cost < 0.0 || cost < collapse.cost) {
+                        collapse.cost = cost;
+                        collapse.from = b;
+                        collapse.to = a;
+                    }
+                }
+                if (collapse.cost >= 0.0) {
+                    collapses.push_back(collapse);
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        // 安い順に縮める. 1回のパスでは, 周りの三角形が変わったグループはもう動かさない
+        const size_t trianglesToRemove = (indices_.size() - targetIndexCount + 2) / 3;
+        std::vector<bool> touched(numGroups, false);
+        std::vector<uint32_t> remap(vertices_.size());
+        for (size_t v = 0; v < remap.size(); v++) {
+            remap[v] = (uint32_t)v;
+        }
+        size_t removed = 0;
+        int applied = 0;
+        for (size_t c = 0; c < collapses.size() && removed < trianglesToRemove; c++) {
+            const Collapse &collapse = collapses[c];
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+            const uint32_t *triangles = &adjacency[offsets[collapse.from]];
+            const uint32_t count = offsets[collapse.from + 1] - offsets[collapse.from];
+            if (flips(collapse.from, collapse.to, triangles, count)) {
+                continue;
+            }
+
+            for (uint32_t i = 0; i < count; i++) {
+                const uint32_t *tri = &indices_[triangles[i] * 3];
+                bool hasTo = false;
+                for (int k = 0; k < 3; k++) {
+                    touched[group_[tri[k]]] = true;
+                    hasTo = hasTo || group_[tri[k]] == collapse.to;
+                }
+                if (hasTo) {
+                    removed++;
+                }
+            }
+            const std::vector<uint32_t> &moving = groupVertices_[collapse.from];
+            for (size_t m = 0; m < moving.size(); m++) {
+                remap[moving[m]] = nearestVertex(moving[m], collapse.to);
+            }
+            quadrics_[collapse.to].add(quadrics_[collapse.from]);
+            error_ = std::max(error_, std::sqrt(collapse.cost));
+            applied++;
+        }
+        if (applied == 0) {
+            break;
+        }
+
+        // 付け替えて, 潰れた三角形を捨てる
+        std::vector<uint32_t> next;
+        next.reserve(indices_.size());
+        for (size_t t = 0; t < numTriangles; t++) {
+            const uint32_t a = remap[indices_[t * 3 + 0]];
+            const uint32_t b = remap[indices_[t * 3 + 1]];
+            const uint32_t c = remap[indices_[t * 3 + 2]];
+            if (group_[a] == group_[b] || group_[b] == group_[c] || group_[c] == group_[a]) {
+                continue;
+            }
+            next.push_back(a);
+            next.push_back(b);
+            next.push_back(c);
+        }
+        indices_.swap(next);
+    }
+}
+
+}  // namespace
+
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices,
+                                   size_t targetIndexCount, float *error) {
+    Simplifier simplifier(indices, vertices);
+    simplifier.run(targetIndexCount);
+    if (error) {
+        *error = simplifier.error();
+    }
+    return simplifier.indices();
+}
+
+void buildLods(MeshData *mesh, int maxLevels, float ratio, int minTriangles) {
+    mesh->lods.clear();
+    MeshLod full;
+    full.firstIndex = 0;
+    full.indexCount = (uint32_t)mesh->indices.size();
+    full.error = 0.0f;
+    mesh->lods.push_back(full);
+
+    // 前の LOD から続けて減らすので, 誤差は元のメッシュからの分が積み上がる
+    Simplifier simplifier(mesh->indices, mesh->vertices);
+    size_t previousCount = mesh->indices.size();
+    for (int level = 1; level < maxLevels; level++) {
+        const size_t target = (size_t)(previousCount / 3 * ratio) * 3;
+        if (target / 3 < (size_t)minTriangles) {
+            break;
+        }
+        simplifier.run(target);
+
+        // ほとんど減らせなかったら, それ以上は作らない
+        std::vector<uint32_t> lodIndices = simplifier.indices();
+        if (lodIndices.size() > previousCount * 3 / 4) {
+            break;
+        }
+        optimizeVertexCache(&lodIndices, mesh->vertices.size());
+
+        MeshLod lod;
+        lod.firstIndex = (uint32_t)mesh->indices.size();
+        lod.indexCount = (uint32_t)lodIndices.size();
+        lod.error = simplifier.error();
+        mesh->lods.push_back(lod);
+        mesh->indices.insert(mesh->indices.end(), lodIndices.begin(), lodIndices.end());
+        previousCount = lodIndices.size();
+    }
+}
@@ -0,0 +1,23 @@
+#ifndef _CORIOLIS_MESH_SIMPLIFY_H_
+#define _CORIOLIS_MESH_SIMPLIFY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "mesh_data.h"
+
+// 二次誤差 (quadric error) で辺を縮めてメッシュを粗くし, LOD の列を作る (OpenGL には依存しない).
+// 辺は片方の頂点をもう片方に寄せて縮めるので, どの LOD も元の頂点バッファをそのまま使う.
+// 位置が同じ頂点 (法線やテクスチャ座標の継ぎ目) はまとめて動かし, 穴の縁の頂点は動かさない.
+
+// indices の三角形を, インデックスの数が targetIndexCount 以下になるまで (縮められる辺がなくなれば
+// そこまで) 減らしたものを返す. error には元の面からのずれ (メッシュの座標での距離) を返す.
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t> &indices, const std::vector<MeshVertex> &vertices,
+                                   size_t targetIndexCount, float *error = NULL);
+
+// 三角形の数を ratio 倍ずつ減らした LOD を mesh->lods に加え, そのインデックスを mesh->indices の後ろに足す.
+// minTriangles より少なくなる LOD や, ほとんど減らせなかった LOD は作らない.
+void buildLods(MeshData *mesh, int maxLevels = 4, float ratio = 0.25f, int minTriangles = 256);
+
+#endif  // _CORIOLIS_MESH_SIMPLIFY_H_
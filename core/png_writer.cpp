@@ -0,0 +1,104 @@
+#include "png_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+namespace {
+
+uint32_t crcTable[256];
+bool crcTableReady = false;
+
+uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc) {
+    if (!crcTableReady) {
+        for (uint32_t n = 0; n < 256; n++) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            crcTable[n] = c;
+        }
+        crcTableReady = true;
+    }
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = crcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+void putU32(std::vector<unsigned char> *out, uint32_t value) {
+    out->push_back((unsigned char)(value >> 24));
+    out->push_back((unsigned char)(value >> 16));
+    out->push_back((unsigned char)(value >> 8));
+    out->push_back((unsigned char)value);
+}
+
+// 長さ, 種類, 中身, (種類と中身の) CRC の順に書く
+void writeChunk(FILE *fp, const char *type, const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> chunk;
+    putU32(&chunk, (uint32_t)data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putU32(&chunk, crc32(chunk.data() + 4, chunk.size() - 4, 0));
+    fwrite(chunk.data(), 1, chunk.size(), fp);
+}
+
+}  // namespace
+
+bool writePng(const std::string &filename, int width, int height, const unsigned char *rgba) {
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(SIGNATURE, 1, sizeof(SIGNATURE), fp);
+
+    // 8 ビット RGBA, インターレースなし
+    std::vector<unsigned char> header;
+    putU32(&header, (uint32_t)width);
+    putU32(&header, (uint32_t)height);
+    const unsigned char format[5] = { 8, 6, 0, 0, 0 };
+    header.insert(header.end(), format, format + 5);
+    writeChunk(fp, "IHDR", header);
+
+    // 各行の先頭にフィルタの種類 (0: なし) を付けた列を zlib の形式で包む
+    const size_t rowSize = (size_t)width * 4;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (int y = 0; y < height; y++) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + rowSize * y, rgba + rowSize * (y + 1));
+    }
+
+    std::vector<unsigned char> zlib;
+    zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t pos = 0;
+    do {
+        const size_t size = std::min(raw.size() - pos, (size_t)65535);
+        const bool last = pos + size == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back((unsigned char)size);
+        zlib.push_back((unsigned char)(size >> 8));
+        zlib.push_back((unsigned char)~size);
+        zlib.push_back((unsigned char)(~size >> 8));
+        zlib.insert(zlib.end(), raw.begin() + pos, raw.begin() + pos + size);
+        pos += size;
+    } while (pos < raw.size());
+
+    uint32_t a = 1, b = 0;
+    for (size_t i = 0; i < raw.size(); i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    putU32(&zlib, (b << 16) | a);
+    writeChunk(fp, "IDAT", zlib);
+    writeChunk(fp, "IEND", std::vector<unsigned char>());
+
+    const bool ok = ferror(fp) == 0;
+    fclose(fp);
+    return ok;
+}
@@ -0,0 +1,11 @@
+#ifndef _CORIOLIS_PNG_WRITER_H_
+#define _CORIOLIS_PNG_WRITER_H_
+
+#include <string>
+
+// RGBA 8 ビットの画像を PNG に書き出す (OpenGL にも外部のライブラリにも依存しない).
+// 圧縮はせず, deflate の無圧縮ブロックに詰めるだけなので速いがファイルは大きい.
+// rgba は上の行から順に width * height * 4 バイト.
+bool writePng(const std::string &filename, int width, int height, const unsigned char *rgba);
+
+#endif  // _CORIOLIS_PNG_WRITER_H_
@@ -0,0 +1,113 @@
+#include "rotating_frame.h"
+
+#include <cstring>
+
+#include "integrator.h"
+
+// 円盤の外に出たら落下させ, 慣性系の位置を求めて当たり判定をする.
+// 円盤の座標系ではピンは止まっているので, ステップの始めの位置 (x0, y0, z0) から直線で結んで調べる.
+static int finishBall(BallStore &balls, int i, float x0, float y0, float z0, const RotatingParams &params) {
+    const float x = balls.localX()[i];
+    const float z = balls.localZ()[i];
+    if (x * x + z * z >= params.diskRadius2) {
+        balls.speedY()[i] += params.gravity;
+        balls.posY()[i] -= balls.speedY()[i];
+    }
+    balls.posX()[i] = params.cosTheta * x + params.sinTheta * z;
+    balls.posZ()[i] = -params.sinTheta * x + params.cosTheta * z;
+    balls.spin()[i] -= params.spinStep;
+
+    balls.impact()[i] = sweptImpact(x0 - params.pin[0], y0 - params.pin[1], z0 - params.pin[2],
+                                    x - params.pin[0], balls.posY()[i] - params.pin[1], z - params.pin[2],
+                                    params.hitRadius2);
+    return balls.impact()[i] >= 0.0f ? 1 : 0;
+}
+
+int stepRotatingEuler(BallStore &balls, const RotatingParams &params) {
+    const float dt = params.dt;
+    const float w2dt = params.omega * params.omega * dt;
+    const float k = params.omega * dt;
+    const float denom = 1.0f / (1.0f + k * k);
+    float *x = balls.localX();
+    float *z = balls.localZ();
+    float *vx = balls.velX();
+    float *vz = balls.velZ();
+
+    int hits = 0;
+    for (int i = 0; i < balls.size(); i++) {
+        const float x0 = x[i], y0 = balls.posY()[i], z0 = z[i];
+
+        // コリオリ力は前後の速度の平均で評価する (速さを変えない回転になり, 陽に計算すると発散する)
+        const float px = vx[i] + w2dt * x[i] - k * vz[i];
+        const float pz = vz[i] + w2dt * z[i] + k * vx[i];
+        vx[i] = (px - k * pz) * denom;
+        vz[i] = (pz + k * px) * denom;
+
+        // 更新した速度で位置を進める
+        x[i] += vx[i] * dt;
+        z[i] += vz[i] * dt;
+        hits += finishBall(balls, i, x0, y0, z0, params);
+    }
+    return hits;
+}
+
+int stepRotatingRK4(BallStore &balls, const RotatingParams &params) {
+    const float w = params.omega;
+    const float w2 = w * w;
+    const float dt = params.dt;
+    float *x = balls.localX();
+    float *z = balls.localZ();
+    float *vx = balls.velX();
+    float *vz = balls.velZ();
+
+    int hits = 0;
+    for (int i = 0; i < balls.size(); i++) {
+        // 状態 (x, z, vx, vz) の時間微分は (vx, vz, ax, az)
+        const float x1 = x[i], z1 = z[i], vx1 = vx[i], vz1 = vz[i];
+        const float ax1 = w2 * x1 - 2.0f * w * vz1;
+        const float az1 = w2 * z1 + 2.0f * w * vx1;
+
+        const float x2 = x1 + 0.5f * dt * vx1, z2 = z1 + 0.5f * dt * vz1;
+        const float vx2 = vx1 + 0.5f * dt * ax1, vz2 = vz1 + 0.5f * dt * az1;
+        const float ax2 = w2 * x2 - 2.0f * w * vz2;
+        const float az2 = w2 * z2 + 2.0f * w * vx2;
+
+        const float x3 = x1 + 0.5f * dt * vx2, z3 = z1 + 0.5f * dt * vz2;
+        const float vx3 = vx1 + 0.5f * dt * ax2, vz3 = vz1 + 0.5f * dt * az2;
+        const float ax3 = w2 * x3 - 2.0f * w * vz3;
+        const float az3 = w2 * z3 + 2.0f * w * vx3;
+
+        const float vx4 = vx1 + dt * ax3, vz4 = vz1 + dt * az3;
+        const float x4 = x1 + dt * vx3, z4 = z1 + dt * vz3;
+        const float ax4 = w2 * x4 - 2.0f * w * vz4;
+        const float az4 = w2 * z4 + 2.0f * w * vx4;
+
+        x[i] = x1 + dt / 6.0f * (vx1 + 2.0f * vx2 + 2.0f * vx3 + vx4);
+        z[i] = z1 + dt / 6.0f * (vz1 + 2.0f * vz2 + 2.0f * vz3 + vz4);
+        vx[i] = vx1 + dt / 6.0f * (ax1 + 2.0f * ax2 + 2.0f * ax3 + ax4);
+        vz[i] = vz1 + dt / 6.0f * (az1 + 2.0f * az2 + 2.0f * az3 + az4);
+        hits += finishBall(balls, i, x1, balls.posY()[i], z1, params);
+    }
+    return hits;
+}
+
+const char *dynamicsName(Dynamics dynamics) {
+    switch (dynamics) {
+        case DYNAMICS_EULER:
+            return "euler";
+        case DYNAMICS_RK4:
+            return "rk4";
+        default:
+            return "chord";
+    }
+}
+
+bool findDynamics(const char *name, Dynamics *dynamics) {
+    for (int d = 0; d < NUM_DYNAMICS; d++) {
+        if (std::strcmp(name, dynamicsName((Dynamics)d)) == 0) {
+            *dynamics = (Dynamics)d;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,41 @@
+#ifndef _CORIOLIS_ROTATING_FRAME_H_
+#define _CORIOLIS_ROTATING_FRAME_H_
+
+#include "ball_store.h"
+
+// 円盤に固定した (回転する) 座標系での運動方程式
+//
+//   a' = -2 Ω x v' - Ω x (Ω x r')
+//
+// をそのまま積分する. 円盤の座標系ではピンも投げる位置も動かないので,
+// ボールごとに三角関数を計算する必要がない.
+
+enum Dynamics {
+    DYNAMICS_CHORD,     // 慣性系での直線を run で補間する (元の実装)
+    DYNAMICS_EULER,     // 回転座標系で半陰的オイラー法 (1次精度. 円盤から落ちる時刻は直線の補間と大きくずれうる)
+    DYNAMICS_RK4,       // 回転座標系で4次のルンゲ・クッタ法
+    NUM_DYNAMICS
+};
+
+struct RotatingParams {
+    float omega;            // 円盤の角速度 [rad/s]
+    float dt;               // 1ステップの時間 [s]
+    float spinStep;         // 1ステップあたりのボール自身の回転角
+    float diskRadius2;      // 円盤の半径の2乗
+    float gravity;          // 1ステップあたりの落下速度の増分
+    float cosTheta;         // 円盤の座標系から慣性系への回転
+    float sinTheta;
+    float pin[3];           // 円盤の座標系でのピンの位置
+    float hitRadius2;       // 当たり判定の距離の2乗
+};
+
+// 戻り値はステップの間にピンに当たったボールの数 (当たった時刻は impact の列に書く)
+int stepRotatingEuler(BallStore &balls, const RotatingParams &params);
+int stepRotatingRK4(BallStore &balls, const RotatingParams &params);
+
+const char *dynamicsName(Dynamics dynamics);
+
+// dynamicsName() の名前から計算方法を求める. 知らない名前なら false
+bool findDynamics(const char *name, Dynamics *dynamics);
+
+#endif  // _CORIOLIS_ROTATING_FRAME_H_
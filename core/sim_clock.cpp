@@ -0,0 +1,24 @@
+#include "sim_clock.h"
+
+SimClock::SimClock(double dt, double maxFrameTime)
+: dt_(dt)
+, maxFrameTime_(maxFrameTime)
+, accumulator_(0.0) {
+}
+
+int SimClock::advance(double frameTime) {
+    if (frameTime > maxFrameTime_) {
+        frameTime = maxFrameTime_;
+    }
+    if (frameTime < 0.0) {
+        frameTime = 0.0;
+    }
+
+    accumulator_ += frameTime;
+    int steps = 0;
+    while (accumulator_ >= dt_) {
+        accumulator_ -= dt_;
+        steps++;
+    }
+    return steps;
+}
@@ -0,0 +1,27 @@
+#ifndef _CORIOLIS_SIM_CLOCK_H_
+#define _CORIOLIS_SIM_CLOCK_H_
+
+// 描画のフレームレートとは独立に, 固定の時間刻みでシミュレーションを進めるための時計.
+// 経過時間を貯めておき, dt ずつ取り出してステップ数に換算する.
+class SimClock {
+public:
+    explicit SimClock(double dt = 1.0 / 60.0, double maxFrameTime = 0.25);
+
+    // 前のフレームからの経過時間を加え, 今回進めるステップ数を返す
+    int advance(double frameTime);
+
+    // 直前の2ステップの間のどこを描画するか [0, 1)
+    float alpha() const { return (float)(accumulator_ / dt_); }
+
+    double dt() const { return dt_; }
+    void setDt(double dt) { dt_ = dt; }
+
+    void reset() { accumulator_ = 0.0; }
+
+private:
+    double dt_;
+    double maxFrameTime_;   // 処理落ちしたときに一度に進める時間の上限
+    double accumulator_;
+};
+
+#endif  // _CORIOLIS_SIM_CLOCK_H_
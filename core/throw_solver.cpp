@@ -0,0 +1,147 @@
+#include "throw_solver.h"
+
+#include <algorithm>
+#include <cmath>
+
+static const double PI = 4.0 * std::atan(1.0);
+
+namespace {
+
+// 慣性系で直線上を進むボールと, 円盤と一緒に回るピン
+struct ThrowPath {
+    double sx, sz;          // 始点
+    double vx, vz;          // 速度
+    double dy;              // ボールとピンの高さの差
+    double pinRadius;
+    double theta0;          // 投げたときの円盤の角度
+    double omega;
+
+    // |s + v t| = radius となる正の t (始点の方が外にあれば 0)
+    double crossingTime(double radius) const {
+        const double a = vx * vx + vz * vz;
+        const double b = sx * vx + sz * vz;
+        const double c = sx * sx + sz * sz - radius * radius;
+        if (c >= 0.0) {
+            return 0.0;
+        }
+        return (-b + std::sqrt(b * b - a * c)) / a;
+    }
+
+    // 原点から見たボールの向きとピンの向きの差
+    double bearingGap(double t) const {
+        const double ball = std::atan2(sx + vx * t, sz + vz * t);
+        const double pin = theta0 + omega * t + PI;
+        return ball - pin;
+    }
+
+    // 時刻 t での距離の2乗と, その1階・2階微分の半分
+    double evaluate(double t, double *g1, double *g2) const {
+        const double alpha = theta0 + omega * t;
+        const double qx = -pinRadius * std::sin(alpha);
+        const double qz = -pinRadius * std::cos(alpha);
+        const double dx = sx + vx * t - qx;
+        const double dz = sz + vz * t - qz;
+        const double ux = vx - omega * qz;     // ボールとピンの相対速度
+        const double uz = vz + omega * qx;
+        *g1 = dx * ux + dz * uz;
+        *g2 = ux * ux + uz * uz + omega * omega * (dx * qx + dz * qz);
+        return dx * dx + dy * dy + dz * dz;
+    }
+
+    // 距離の2乗の極小をニュートン法で求める (結果は [lo, hi] に収め, 遠ざかる向きには進まない)
+    double refine(double t, double lo, double hi, double *dist2) const {
+        double g1, g2;
+        double d2 = evaluate(t, &g1, &g2);
+        for (int iter = 0; iter < 6 && g2 > 0.0; iter++) {
+            const double next = std::max(lo, std::min(t - g1 / g2, hi));
+            double nextG1, nextG2;
+            const double nextD2 = evaluate(next, &nextG1, &nextG2);
+            if (nextD2 >= d2) {
+                break;
+            }
+            t = next;
+            d2 = nextD2;
+            g1 = nextG1;
+            g2 = nextG2;
+        }
+        *dist2 = d2;
+        return t;
+    }
+};
+
+// 角度を (-PI, PI] に収める
+double wrapAngle(double a) {
+    return a - 2.0 * PI * std::floor((a + PI) / (2.0 * PI));
+}
+
+}  // namespace
+
+ThrowSolution solveThrow(const LaneConfig &config, float arrowAngle, int speedIndex, float releaseTheta) {
+    const double r = config.releaseRadius;
+    const double speed = BALL_SPEEDS[std::max(0, std::min(speedIndex, NUM_BALL_SPEEDS - 1))];
+    const double goalAngle = releaseTheta - (PI - 2.0 * arrowAngle);
+
+    ThrowPath path;
+    path.sx = r * std::sin((double)releaseTheta);
+    path.sz = r * std::cos((double)releaseTheta);
+    path.vx = speed * (r * std::sin(goalAngle) - path.sx);
+    path.vz = speed * (r * std::cos(goalAngle) - path.sz);
+    path.dy = config.releaseHeight - config.pinHeight;
+    path.pinRadius = config.pinRadius;
+    path.theta0 = releaseTheta;
+    path.omega = config.omega;
+
+    // ピンの半径のまわり (当たり判定の距離の2倍の幅) を通っている間だけを調べる
+    const double margin = 2.0 * config.hitRadius;
+    const double exitTime = path.crossingTime(config.diskRadius);
+    const double t0 = path.crossingTime(config.pinRadius - margin);
+    const double t1 = std::min(path.crossingTime(config.pinRadius + margin), exitTime);
+
+    // 向きの差が 2PI の倍数になる時刻の近くが極小の候補.
+    // 向きの差が区間ごとに PI/4 程度しか変わらないように分けて, 線形補間で候補を探す.
+    // 向きが揃う前に円盤の外に出ることもあるので, 範囲の両端からも探す.
+    const double ball0 = std::atan2(path.sx + path.vx * t0, path.sz + path.vz * t0);
+    const double ball1 = std::atan2(path.sx + path.vx * t1, path.sz + path.vz * t1);
+    const double sweep = std::fabs(wrapAngle(ball1 - ball0)) + std::fabs(path.omega) * (t1 - t0);
+    const int segments = 1 + (int)(sweep / (PI / 4.0));
+
+    double bestDist2;
+    double bestTime = path.refine(t0, t0, t1, &bestDist2);
+    double d2;
+    double t = path.refine(t1, t0, t1, &d2);
+    if (d2 < bestDist2) {
+        bestTime = t;
+        bestDist2 = d2;
+    }
+
+    double ta = t0;
+    double gapA = wrapAngle(path.bearingGap(t0));
+    for (int s = 1; s <= segments; s++) {
+        const double tb = t0 + (t1 - t0) * s / segments;
+        const double gapB = gapA + wrapAngle(path.bearingGap(tb) - gapA);
+        const double lo = std::min(gapA, gapB);
+        const double hi = std::max(gapA, gapB);
+        for (double k = std::ceil(lo / (2.0 * PI)); 2.0 * PI * k <= hi; k += 1.0) {
+            const double f = (2.0 * PI * k - gapA) / (gapB - gapA);
+            t = path.refine(ta + f * (tb - ta), t0, t1, &d2);
+            if (d2 < bestDist2) {
+                bestTime = t;
+                bestDist2 = d2;
+            }
+        }
+        ta = tb;
+        gapA = gapB;
+    }
+
+    ThrowSolution solution;
+    solution.exitTime = (float)exitTime;
+    solution.closestTime = (float)bestTime;
+    solution.missDistance = (float)std::sqrt(bestDist2);
+    solution.hit = solution.missDistance <= config.hitRadius;
+    return solution;
+}
+
+float throwSolverTolerance(const LaneConfig &config) {
+    const double halfStep = 0.5 * std::fabs((double)config.omega * config.dt);
+    return (float)(config.pinRadius * (1.0 - std::cos(std::min(halfStep, PI / 2.0))));
+}
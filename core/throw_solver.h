@@ -0,0 +1,32 @@
+#ifndef _CORIOLIS_THROW_SOLVER_H_
+#define _CORIOLIS_THROW_SOLVER_H_
+
+#include "lane.h"
+
+// 直線の補間 (DYNAMICS_CHORD) で投げたボールがピンに当たるかを, ステップを刻まずに求める.
+//
+// 慣性系ではボールは直線上を等速で進むので, ピンと同じ半径を横切る時刻は2次方程式で決まる.
+// その時刻から, 回っているピンとの距離の2乗をニュートン法で最小化して最接近を求める.
+// (ピンの近くを通るのは外へ向かってピンの半径を横切るときだけなので, これで十分)
+//
+// 精度: ここでは回っているピンとの本当の最接近を求めるが, Lane::step() はステップの間のピンの動きを
+// 弧ではなく弦で近似して当たり判定をする. 弦は弧より最大で throwSolverTolerance() だけ内側を通るので,
+// missDistance と hitRadius の差がそれ以下の投げ方ではステップを刻んだ結果と食い違うことがある.
+// (既定の設定で 60 Hz なら 3e-5, 10 Hz なら 1.2e-3 程度. それより外側では必ず一致する)
+//
+// 速さ: 1回あたり三角関数を数十回呼ぶので 1 us 程度かかる. ステップを刻むと数百ステップかかる投げ方を
+// まとめて調べるためのもので, 1ステップごとに呼ぶほど軽くはない.
+
+struct ThrowSolution {
+    bool hit;               // ピンに当たるか
+    float closestTime;      // 投げてから最も近づくまでの時間 [s]
+    float missDistance;     // 最も近づいたときのボールとピンの中心の距離
+    float exitTime;         // 投げてから円盤の外に出るまでの時間 [s]
+};
+
+ThrowSolution solveThrow(const LaneConfig &config, float arrowAngle, int speedIndex, float releaseTheta);
+
+// ステップを刻んだ当たり判定との食い違いがありうる, hitRadius のまわりの幅 (ピンの弧と弦の距離の最大値)
+float throwSolverTolerance(const LaneConfig &config);
+
+#endif  // _CORIOLIS_THROW_SOLVER_H_
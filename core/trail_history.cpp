@@ -0,0 +1,94 @@
+#include "trail_history.h"
+
+#include <algorithm>
+
+namespace {
+
+const int INITIAL_SLOTS = 16;
+
+}  // namespace
+
+TrailHistory::TrailHistory(int length)
+: length_(std::max(length, 2))
+, numSlots_(0)
+, lastHandle_(0) {
+    grow(INITIAL_SLOTS);
+}
+
+void TrailHistory::clear() {
+    handles_.clear();
+    lastHandle_ = 0;
+}
+
+void TrailHistory::record(const BallHandle *handles, int numBalls, const float *pos) {
+    if (numBalls == 0) {
+        handles_.clear();
+        return;
+    }
+    // 前回より古いハンドル (前回いなかったのに, もう足したことのあるハンドル) から始まっていたらやり直し
+    if (handles[0] <= lastHandle_ && (handles_.empty() || handles[0] < handles_[0])) {
+        clear();
+    }
+    // 生きているボールのハンドルが同じ場所に重ならないようにする
+    const BallHandle span = handles[numBalls - 1] - handles[0] + 1;
+    if (span > (BallHandle)numSlots_) {
+        grow(std::max((int)span, 2 * numSlots_));
+    }
+
+    const bool fresh = handles_.empty();
+    for (int i = 0; i < numBalls; i++) {
+        const BallHandle handle = handles[i];
+        const int s = slot(handle);
+        if (fresh || handle > lastHandle_) {
+            heads_[s] = 0;
+            counts_[s] = 0;
+        }
+        std::copy(pos + i * 3, pos + i * 3 + 3, &points_[((size_t)s * length_ + heads_[s]) * 3]);
+        heads_[s] = (heads_[s] + 1) % length_;
+        counts_[s] = std::min(counts_[s] + 1, length_);
+    }
+    handles_.assign(handles, handles + numBalls);
+    lastHandle_ = std::max(lastHandle_, handles[numBalls - 1]);
+}
+
+int TrailHistory::totalPoints() const {
+    int total = 0;
+    for (int i = 0; i < numTrails(); i++) {
+        total += count(i);
+    }
+    return total;
+}
+
+int TrailHistory::write(int i, float *out) const {
+    const int s = slot(handles_[i]);
+    const int n = counts_[s];
+    const int oldest = (heads_[s] - n + length_) % length_;
+    const float *points = &points_[(size_t)s * length_ * 3];
+    for (int k = 0; k < n; k++) {
+        const float *p = points + ((oldest + k) % length_) * 3;
+        out[k * 4 + 0] = p[0];
+        out[k * 4 + 1] = p[1];
+        out[k * 4 + 2] = p[2];
+        out[k * 4 + 3] = (float)(n - 1 - k) / (float)(length_ - 1);
+    }
+    return n;
+}
+
+void TrailHistory::grow(int numSlots) {
+    std::vector<float> points((size_t)numSlots * length_ * 3);
+    std::vector<int> heads(numSlots, 0);
+    std::vector<int> counts(numSlots, 0);
+    for (size_t i = 0; i < handles_.size(); i++) {
+        const BallHandle handle = handles_[i];
+        const int from = slot(handle);
+        const int to = (int)(handle % (BallHandle)numSlots);
+        std::copy(&points_[(size_t)from * length_ * 3], &points_[(size_t)(from + 1) * length_ * 3],
+                  &points[(size_t)to * length_ * 3]);
+        heads[to] = heads_[from];
+        counts[to] = counts_[from];
+    }
+    points_.swap(points);
+    heads_.swap(heads);
+    counts_.swap(counts);
+    numSlots_ = numSlots;
+}
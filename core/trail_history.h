@@ -0,0 +1,49 @@
+#ifndef _CORIOLIS_TRAIL_HISTORY_H_
+#define _CORIOLIS_TRAIL_HISTORY_H_
+
+#include <vector>
+
+#include "ball_store.h"
+
+// ボールごとに直前の length 個の位置を覚えておく (軌跡の描画用. シミュレーションには関係しない).
+// ボールはハンドルで区別する (BallStore と同じく昇順に並ぶが, 途中のボールが消えて飛ぶこともある).
+// 軌跡は handle % 容量 の場所に置き, 容量は生きているハンドルの幅より大きくしておくので, ボールが消えても詰め直さない.
+class TrailHistory {
+public:
+    explicit TrailHistory(int length = 64);
+
+    void clear();
+
+    // ハンドルが handles (昇順) の numBalls 個のボールの位置 pos (x, y, z を numBalls 個) を1つずつ足す.
+    // 前回いなかったハンドルは新しい軌跡として始め, 前回より古いハンドルから始まっていたら (ゲームをやり直したとき) 全部捨てる
+    void record(const BallHandle *handles, int numBalls, const float *pos);
+
+    int length() const { return length_; }
+    int numTrails() const { return (int)handles_.size(); }
+
+    // i 番目 (古いボールから順) の軌跡の点の数
+    int count(int i) const { return counts_[slot(handles_[i])]; }
+
+    // 全部の軌跡の点の数の合計
+    int totalPoints() const;
+
+    // i 番目の軌跡を古い点から順に (x, y, z, age) の4つずつ out に書き, 書いた点の数を返す.
+    // age はいまの位置が 0, length - 1 個前の位置が 1
+    int write(int i, float *out) const;
+
+private:
+    int slot(BallHandle handle) const { return (int)(handle % (BallHandle)numSlots_); }
+
+    // numSlots 本の軌跡を持てるように確保し直し, 生きている軌跡を新しい場所に移す
+    void grow(int numSlots);
+
+    int length_;
+    int numSlots_;
+    std::vector<BallHandle> handles_;   // 前回足したボールのハンドル
+    BallHandle lastHandle_;             // これまでに足した一番新しいハンドル
+    std::vector<float> points_;     // 軌跡ごとに length 個の (x, y, z) のリングバッファ
+    std::vector<int> heads_;        // 次に書く点の位置
+    std::vector<int> counts_;
+};
+
+#endif  // _CORIOLIS_TRAIL_HISTORY_H_
@@ -1,10 +1,16 @@
+#include <algorithm>
+#include <chrono>
+#include <climits>
 #include <cmath>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <fstream>
+#include <map>
 #include <string>
 #include <vector>
-#include <deque>
 
 #define GLFW_INCLUDE_GLU
 #define GLM_ENABLE_EXPERIMENTAL
@@ -14,8 +20,10 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "tiny_obj_loader.h"
+#ifdef CORIOLIS_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -23,15 +31,33 @@
 // ディレクトリの設定ファイル
 #include "common.h"
 
+// レーンのシミュレーション
+#include "core/game.h"
+#include "core/input_log.h"
+#include "core/mesh_data.h"
+#include "core/mesh_optimize.h"
+#include "core/mesh_simplify.h"
+#include "core/png_writer.h"
+#include "core/sim_clock.h"
+#include "core/trail_history.h"
+
 static int WIN_WIDTH   = 1000;                       // ウィンドウの幅
 static int WIN_HEIGHT  = 1000;                       // ウィンドウの高さ
+static int FB_WIDTH    = 1000;                       // 描く先のフレームバッファの幅 (ピクセル数)
+static int FB_HEIGHT   = 1000;                       // 描く先のフレームバッファの高さ
 static const char *WIN_TITLE = "Coriolis_Bowling";   // ウィンドウのタイトル
 
 static const float PI = 4.0 * std::atan(1.0);
-static float theta = 0.0f;
 
 static const std::string RENDER_SHADER       = std::string(SHADER_DIRECTORY) + "render";
 static const std::string TEXTURE_SHADER      = std::string(SHADER_DIRECTORY) + "texture";
+static const std::string INSTANCED_SHADER    = std::string(SHADER_DIRECTORY) + "render_instanced";
+static const std::string TRAIL_SHADER        = std::string(SHADER_DIRECTORY) + "trail";
+static const std::string LEGACY_SHADER       = std::string(SHADER_DIRECTORY) + "render_legacy";   // --bench-draw の lookup 用
+
+// glMultiDrawElementsIndirect でまとめて描くときのシェーダ (オブジェクトごとの値を SSBO から読む)
+static const std::string RENDER_INDIRECT_SHADER    = std::string(SHADER_DIRECTORY) + "render_indirect";
+static const std::string INSTANCED_INDIRECT_SHADER = std::string(SHADER_DIRECTORY) + "render_instanced_indirect";
 
 // スタート画面用のファイル
 static const std::string START_OBJFILE       = std::string(DATA_DIRECTORY) + "square.obj";
@@ -48,7 +74,19 @@ static const std::string BOWLINGPIN2_TEXFILE = std::string(DATA_DIRECTORY) + "bo
 
 // 投げる人間のファイル
 static const std::string PERSON_OBJFILE      = std::string(DATA_DIRECTORY) + "stickman.OBJ";
-static const std::string PERSON_TEXFILE      = std::string(DATA_DIRECTORY) + "color6.png";
+static const int PERSON_COLOR_INDEX = 6;
+
+// 色見本のファイル (ボールと矢印と人の色, 番号がボールの速さに対応する)
+static const std::vector<std::string> PALETTE_TEXFILES = { std::string(DATA_DIRECTORY) + "color0.png",
+                                                           std::string(DATA_DIRECTORY) + "color1.png",
+                                                           std::string(DATA_DIRECTORY) + "color2.png",
+                                                           std::string(DATA_DIRECTORY) + "color3.png",
+                                                           std::string(DATA_DIRECTORY) + "color4.png",
+                                                           std::string(DATA_DIRECTORY) + "color5.png",
+                                                           std::string(DATA_DIRECTORY) + "color6.png",
+                                                           std::string(DATA_DIRECTORY) + "color7.png",
+                                                           std::string(DATA_DIRECTORY) + "color8.png",
+                                                           std::string(DATA_DIRECTORY) + "color9.png" };
 
 // 円盤のファイル
 static const std::string CYLINDER_OBJFILE    = std::string(DATA_DIRECTORY) + "cylinder_thin.obj";
@@ -56,29 +94,9 @@ static const std::string CYLINDER_TEXFILE    = std::string(DATA_DIRECTORY) + "cy
 
 // ボーリングのボールのファイル
 static const std::string BOWLINGBALL_OBJFILE = std::string(DATA_DIRECTORY) + "Bowling_ball/Bowling_ball.obj";
-static const std::vector<std::string> BOWLINGBALL_TEXFILES = { std::string(DATA_DIRECTORY) + "color0.png",
-                                                               std::string(DATA_DIRECTORY) + "color1.png",
-                                                               std::string(DATA_DIRECTORY) + "color2.png",
-                                                               std::string(DATA_DIRECTORY) + "color3.png",
-                                                               std::string(DATA_DIRECTORY) + "color4.png",
-                                                               std::string(DATA_DIRECTORY) + "color5.png",
-                                                               std::string(DATA_DIRECTORY) + "color6.png",
-                                                               std::string(DATA_DIRECTORY) + "color7.png",
-                                                               std::string(DATA_DIRECTORY) + "color8.png",
-                                                               std::string(DATA_DIRECTORY) + "color9.png" };
 
 // 矢印のファイル
 static const std::string ARROW_OBJFILE = std::string(DATA_DIRECTORY) + "arrow/arrow.obj";
-static const std::vector<std::string> ARROW_TEXFILES = { std::string(DATA_DIRECTORY) + "color0.png",
-                                                         std::string(DATA_DIRECTORY) + "color1.png",
-                                                         std::string(DATA_DIRECTORY) + "color2.png",
-                                                         std::string(DATA_DIRECTORY) + "color3.png",
-                                                         std::string(DATA_DIRECTORY) + "color4.png",
-                                                         std::string(DATA_DIRECTORY) + "color5.png",
-                                                         std::string(DATA_DIRECTORY) + "color6.png",
-                                                         std::string(DATA_DIRECTORY) + "color7.png",
-                                                         std::string(DATA_DIRECTORY) + "color8.png",
-                                                         std::string(DATA_DIRECTORY) + "color9.png" };
 
 
 static const glm::vec3 cameraPos = glm::vec3(0.0f, 100.0f, 0.0f);
@@ -86,88 +104,454 @@ static const glm::vec3 eyeTo     = glm::vec3(0.0f, 0.0f, 0.0f);
 static const glm::vec3 upVec     = glm::vec3(0.0f, 0.0f, 1.0f);
 static const glm::vec3 lightPos  = glm::vec3(0.0f, 1.0f, 0.0f);
 
+// uniform ブロックの結合点とテクスチャユニット (シェーダをリンクしたときに割り当てる)
+static const GLuint FRAME_UNIFORMS_BINDING  = 0;
+static const GLuint OBJECT_UNIFORMS_BINDING = 1;
+static const GLuint DRAW_DATA_BINDING       = 0;    // SSBO (まとめて描くときのオブジェクトごとの値)
+static const GLint TEXTURE_UNIT = 0;
+static const GLint PALETTE_UNIT = 1;
 
-struct Vertex {
-    Vertex()
-    : position(0.0f, 0.0f, 0.0f)
-    , normal(0.0f, 0.0f, 0.0f)
-    , texcoord(0.0f, 0.0f) {
-    }
-    
-    Vertex(const glm::vec3 &pos, const glm::vec3 &norm, const glm::vec2 &uv)
-    : position(pos)
-    , normal(norm)
-    , texcoord(uv) {
-    }
-    
-    glm::vec3 position;
-    glm::vec3 normal;
-    glm::vec2 texcoord;
-};
 
 struct Camera {
     glm::mat4 viewMat;
     glm::mat4 projMat;
 };
 
+// 1つのカメラで描く, フレームバッファの中の長方形.
+// 深度の範囲を分けておくと, 重なったビュー (ピクチャインピクチャ) でも手前の範囲のビューが上に描かれる.
+struct View {
+    Camera camera;
+    int x;
+    int y;
+    int width;
+    int height;
+    float depthNear;
+    float depthFar;
+};
 
-struct RenderObject {
-    GLuint programId;
+static const int MAX_VIEWS = 2;         // シェーダの u_views の数
+
+// ビューの並べ方 (--view か V キーで選ぶ)
+enum {
+    VIEW_LAYOUT_SINGLE,     // 選んでいるカメラ (Space で切り替え) だけを描く
+    VIEW_LAYOUT_SPLIT,      // 投げる人の後ろからと上からを左右に並べる
+    VIEW_LAYOUT_PIP,        // 選んでいるカメラの右上に, もう一方のカメラを小さく重ねる
+    NUM_VIEW_LAYOUTS
+};
+
+static const char *VIEW_LAYOUT_NAMES[] = { "single", "split", "pip" };
+
+
+GLsizeiptr indexSize(GLenum indexType) {
+    return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+
+// 頂点の形式とインデックスの型が同じメッシュをまとめて置く1組の VBO/IBO と, それを読む VAO.
+// メッシュは baseVertex と firstIndex で自分の範囲を指すので, 同じ区画のメッシュは VAO を切り替えずに描ける.
+// 中身は CPU 側に貯めておき, upload() でまとめて送る (VAO はバッファの名前を指すので作り直さなくてよい).
+struct GeometryArena {
     GLuint vaoId;
     GLuint vboId;
     GLuint iboId;
-    GLuint textureId;
-    int bufferSize;
+    bool packed;            // 頂点を PackedVertex に詰めて置くか
+    GLenum indexType;       // すべてのメッシュの頂点が 65536 個以下なら GL_UNSIGNED_SHORT
+    std::vector<unsigned char> vertexBytes;
+    std::vector<unsigned char> indexBytes;
+    bool dirty;             // 最後に upload() してから足したメッシュがあるか
     
-    glm::mat4 modelMat;
-    glm::vec3 ambiColor;
-    glm::vec3 diffColor;
-    glm::vec3 specColor;
-    float shininess;
+    void initialize(bool packedVertices, GLenum type) {
+        packed = packedVertices;
+        indexType = type;
+        dirty = false;
+        glGenVertexArrays(1, &vaoId);
+        glGenBuffers(1, &vboId);
+        glGenBuffers(1, &iboId);
+        glBindVertexArray(vaoId);
+        bindAttributes();
+        glBindVertexArray(0);
+    }
     
-    void initialize() {
-        programId = 0u;
-        vaoId = 0u;
-        vboId = 0u;
-        iboId = 0u;
-        textureId = 0u;
-        bufferSize = 0;
+    size_t vertexSize() const {
+        return packed ? sizeof(PackedVertex) : sizeof(MeshVertex);
+    }
+    
+    size_t numVertices() const {
+        return vertexBytes.size() / vertexSize();
+    }
+    
+    size_t numIndices() const {
+        return indexBytes.size() / indexSize(indexType);
+    }
+    
+    // メッシュの頂点とインデックスを後ろに足し, その位置を返す (インデックスはメッシュの中の番号のまま)
+    void append(const void *vertices, size_t vertexCount, const void *indices, size_t indexCount,
+                GLint *baseVertex, GLuint *firstIndex) {
+        *baseVertex = (GLint)numVertices();
+        *firstIndex = (GLuint)numIndices();
+        const unsigned char *v = (const unsigned char*)vertices;
+        const unsigned char *i = (const unsigned char*)indices;
+        vertexBytes.insert(vertexBytes.end(), v, v + vertexCount * vertexSize());
+        indexBytes.insert(indexBytes.end(), i, i + indexCount * indexSize(indexType));
+        dirty = true;
+    }
+    
+    void upload() {
+        if (!dirty) {
+            return;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, vboId);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes.size(), vertexBytes.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes.size(), indexBytes.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        dirty = false;
+    }
+    
+    // 今バインドしている VAO に, この区画の頂点属性 (0〜2) とインデックスを設定する.
+    // 詰めた頂点は正規化した整数として読ませ, 元の範囲には render.vert で戻す.
+    void bindAttributes() const {
+        glBindBuffer(GL_ARRAY_BUFFER, vboId);
+        if (packed) {
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, position));
+            glEnableVertexAttribArray(1);
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+            glEnableVertexAttribArray(2);
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, texcoord));
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
+            return;
+        }
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void*)offsetof(MeshVertex, texcoord));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
+    }
+    
+    void release() {
+        glDeleteVertexArrays(1, &vaoId);
+        glDeleteBuffers(1, &vboId);
+        glDeleteBuffers(1, &iboId);
+        vertexBytes.clear();
+        indexBytes.clear();
+    }
+};
+
+
+// GPU に送ったメッシュ (頂点とインデックスは GeometryArena の中の範囲)
+struct Mesh {
+    const GeometryArena *arena;
+    GLuint vaoId;
+    GLuint vboId;
+    GLuint iboId;
+    GLint baseVertex;
+    int bufferSize;         // 一番細かい LOD のインデックスの数
+    GLenum indexType;
+    std::vector<MeshLod> lods;      // firstIndex は区画の中の位置
+    bool packed;            // 頂点を PackedVertex に詰めて送ったか
+    VertexQuantization quantization;
+    MeshBounds bounds;
+};
+
+
+// OBJ ファイルのパスごとにメッシュを1回だけ読み込み, 同じファイルを使うオブジェクトで共有する.
+// メッシュは頂点の形式とインデックスの型ごとの区画に詰めていく (ふつうは1つか2つの区画に収まる).
+struct MeshCache {
+    std::map<std::string, Mesh> meshes;
+    std::map<int, GeometryArena> arenas;
+    
+    const Mesh &get(const std::string &filename) {
+        std::map<std::string, Mesh>::iterator it = meshes.find(filename);
+        if (it == meshes.end()) {
+            it = meshes.insert(std::make_pair(filename, load(filename))).first;
+        }
+        return it->second;
+    }
+    
+    // 足したメッシュをまとめて GPU に送る (描く前に呼ぶ)
+    void upload() {
+        for (std::map<int, GeometryArena>::iterator it = arenas.begin(); it != arenas.end(); ++it) {
+            it->second.upload();
+        }
+    }
+    
+    void release() {
+        for (std::map<int, GeometryArena>::iterator it = arenas.begin(); it != arenas.end(); ++it) {
+            it->second.release();
+        }
+        arenas.clear();
+        meshes.clear();
+    }
+    
+    GeometryArena &arena(bool packed, GLenum indexType) {
+        const int key = (packed ? 2 : 0) + (indexType == GL_UNSIGNED_SHORT ? 1 : 0);
+        std::map<int, GeometryArena>::iterator it = arenas.find(key);
+        if (it == arenas.end()) {
+            it = arenas.insert(std::make_pair(key, GeometryArena())).first;
+            it->second.initialize(packed, indexType);
+        }
+        return it->second;
+    }
+    
+    // 同じ頂点はまとめて, 頂点キャッシュに当たりやすく並べ替え, インデックスは収まれば 16 ビットで送る
+    Mesh load(const std::string &filename) {
+        MeshData data;
+        std::string err;
+        const bool success = loadMeshData(filename, &data, &err);
+        if (!err.empty()) {
+            std::cerr << "[WARNING] " << err << std::endl;
+        }
         
-        ambiColor = glm::vec3(0.0f, 0.0f, 0.0f);
-        diffColor = glm::vec3(1.0f, 1.0f, 1.0f);
-        specColor = glm::vec3(0.0f, 0.0f, 0.0f);
+        if (!success) {
+            std::cerr << "Failed to load OBJ file: " << filename << std::endl;
+            exit(1);
+        }
+        const float acmrBefore = computeACMR(data.indices, data.vertices.size());
+        optimizeMesh(&data);
+        printf("%s\n", meshReport(filename.substr(filename.find_last_of("/\\") + 1), data).c_str());
+        printf("    ACMR %.3f -> %.3f\n", acmrBefore, computeACMR(data.indices, data.vertices.size()));
+        
+        // 遠くで小さく見えるときのために, 粗いメッシュを同じインデックスバッファの後ろに足しておく
+        buildLods(&data);
+        printf("    LOD:");
+        for (size_t l = 0; l < data.lods.size(); l++) {
+            printf(" %d", data.lods[l].indexCount / 3);
+        }
+        printf(" triangles\n");
+        
+        // 誤差が十分小さいメッシュは頂点を半分の大きさに詰める
+        Mesh mesh;
+        std::vector<PackedVertex> packedVertices;
+        mesh.packed = packVertices(data, &packedVertices, &mesh.quantization);
+        if (mesh.packed) {
+            printf("    packed vertices: %zu -> %zu bytes\n", data.vertexBytes(), sizeof(PackedVertex) * packedVertices.size());
+        } else {
+            mesh.quantization = VertexQuantization();
+        }
+        mesh.indexType = data.fitsShortIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+        
+        GeometryArena &target = arena(mesh.packed, mesh.indexType);
+        const void *vertices = mesh.packed ? (const void*)packedVertices.data() : (const void*)data.vertices.data();
+        std::vector<uint16_t> shortIndices;
+        const void *indices = data.indices.data();
+        if (mesh.indexType == GL_UNSIGNED_SHORT) {
+            shortIndices = data.shortIndices();
+            indices = shortIndices.data();
+        }
+        GLuint firstIndex;
+        target.append(vertices, data.vertices.size(), indices, data.indices.size(), &mesh.baseVertex, &firstIndex);
+        
+        mesh.arena = &target;
+        mesh.vaoId = target.vaoId;
+        mesh.vboId = target.vboId;
+        mesh.iboId = target.iboId;
+        mesh.bufferSize = data.lods[0].indexCount;
+        mesh.lods = data.lods;
+        for (size_t l = 0; l < mesh.lods.size(); l++) {
+            mesh.lods[l].firstIndex += firstIndex;
+        }
+        mesh.bounds = computeBounds(data);
+        return mesh;
     }
+};
+
+MeshCache meshCache;
+
+
+// シェーダのファイル名 (拡張子を除く) ごとにプログラムを1回だけ作り, 同じシェーダを使うオブジェクトで共有する.
+// リンクしたプログラムはドライバごとにバイナリとして保存しておき, 次に起動したときはコンパイルしない.
+struct ProgramCache {
+    std::map<std::string, GLuint> programs;
+    int numCompiled;        // 今回コンパイルしたプログラムの数
+    int numLoaded;          // 保存したバイナリから読み込んだプログラムの数
     
-    void buildShader(const std::string &basename) {
+    ProgramCache()
+    : numCompiled(0)
+    , numLoaded(0) {
+    }
+    
+    GLuint get(const std::string &basename) {
+        std::map<std::string, GLuint>::iterator it = programs.find(basename);
+        if (it != programs.end()) {
+            return it->second;
+        }
+        
         const std::string vertShaderFile = basename + ".vert";
         const std::string fragShaderFile = basename + ".frag";
-        
-        // シェーダの用意
-        GLuint vertShaderId = glCreateShader(GL_VERTEX_SHADER);
-        GLuint fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
-        
-        // ファイルの読み込み (Vertex shader)
-        std::ifstream vertFileInput(vertShaderFile.c_str(), std::ios::in);
-        if (!vertFileInput.is_open()) {
+        const std::string vertFileData = readFile(vertShaderFile);
+        const std::string fragFileData = readFile(fragShaderFile);
+        if (vertFileData.empty()) {
             fprintf(stderr, "Failed to load vertex shader: %s\n", vertShaderFile.c_str());
             exit(1);
         }
-        std::istreambuf_iterator<char> vertDataBegin(vertFileInput);
-        std::istreambuf_iterator<char> vertDataEnd;
-        const std::string vertFileData(vertDataBegin,vertDataEnd);
-        const char *vertShaderCode = vertFileData.c_str();
-        
-        // ファイルの読み込み (Fragment shader)
-        std::ifstream fragFileInput(fragShaderFile.c_str(), std::ios::in);
-        if (!fragFileInput.is_open()) {
+        if (fragFileData.empty()) {
             fprintf(stderr, "Failed to load fragment shader: %s\n", fragShaderFile.c_str());
             exit(1);
         }
-        std::istreambuf_iterator<char> fragDataBegin(fragFileInput);
-        std::istreambuf_iterator<char> fragDataEnd;
-        const std::string fragFileData(fragDataBegin,fragDataEnd);
+        
+        // ドライバが変わったりシェーダを書き換えたりしたら, 保存したバイナリは使わない
+        const std::string driver = driverString();
+        const uint64_t sourceHash = fnv1a(vertFileData + '\0' + fragFileData);
+        const std::string binaryFile = binaryFilename(basename, driver);
+        
+        GLuint programId = loadBinary(binaryFile, driver, sourceHash);
+        if (programId != 0) {
+            numLoaded++;
+        } else {
+            programId = compile(vertFileData, fragFileData);
+            saveBinary(programId, binaryFile, driver, sourceHash);
+            numCompiled++;
+        }
+        bindInterface(programId);
+        programs[basename] = programId;
+        return programId;
+    }
+    
+    // uniform ブロックとサンプラの割り当ては描画のたびに調べずに, ここで一度だけ決めておく
+    // (保存したバイナリから読み込んだときも, uniform の値は初期値に戻っている)
+    static void bindInterface(GLuint programId) {
+        const GLuint frameIndex = glGetUniformBlockIndex(programId, "FrameUniforms");
+        if (frameIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(programId, frameIndex, FRAME_UNIFORMS_BINDING);
+        }
+        const GLuint objectIndex = glGetUniformBlockIndex(programId, "ObjectUniforms");
+        if (objectIndex != GL_INVALID_INDEX) {
+            glUniformBlockBinding(programId, objectIndex, OBJECT_UNIFORMS_BINDING);
+        }
+        
+        glUseProgram(programId);
+        glUniform1i(glGetUniformLocation(programId, "u_texture"), TEXTURE_UNIT);
+        glUniform1i(glGetUniformLocation(programId, "u_palette"), PALETTE_UNIT);
+        glUseProgram(0);
+    }
+    
+    void release() {
+        for (std::map<std::string, GLuint>::iterator it = programs.begin(); it != programs.end(); ++it) {
+            glDeleteProgram(it->second);
+        }
+        programs.clear();
+    }
+    
+    static std::string readFile(const std::string &filename) {
+        std::ifstream fileInput(filename.c_str(), std::ios::in | std::ios::binary);
+        if (!fileInput.is_open()) {
+            return std::string();
+        }
+        std::istreambuf_iterator<char> dataBegin(fileInput);
+        std::istreambuf_iterator<char> dataEnd;
+        return std::string(dataBegin, dataEnd);
+    }
+    
+    static uint64_t fnv1a(const std::string &data) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < data.size(); i++) {
+            hash = (hash ^ (unsigned char)data[i]) * 1099511628211ull;
+        }
+        return hash;
+    }
+    
+    static std::string driverString() {
+        const char *vendor = (const char*)glGetString(GL_VENDOR);
+        const char *renderer = (const char*)glGetString(GL_RENDERER);
+        const char *version = (const char*)glGetString(GL_VERSION);
+        return std::string(vendor ? vendor : "") + " / " + (renderer ? renderer : "") + " / " + (version ? version : "");
+    }
+    
+    // 例: <SHADER_CACHE_DIRECTORY>/render.0123456789abcdef.bin
+    static std::string binaryFilename(const std::string &basename, const std::string &driver) {
+        const size_t slash = basename.find_last_of("/\\");
+        const std::string name = slash == std::string::npos ? basename : basename.substr(slash + 1);
+        char hash[32];
+        sprintf(hash, ".%016llx.bin", (unsigned long long)fnv1a(driver));
+        return std::string(SHADER_CACHE_DIRECTORY) + name + hash;
+    }
+    
+    // 保存したバイナリの形式: "CSPB", uint64 シェーダのハッシュ, uint32 ドライバの文字列の長さ, ドライバの文字列,
+    //                       uint32 バイナリの形式, uint32 バイナリの長さ, バイナリ
+    static GLuint loadBinary(const std::string &filename, const std::string &driver, uint64_t sourceHash) {
+        GLint numFormats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+        if (numFormats <= 0) {
+            return 0;
+        }
+        
+        const std::string data = readFile(filename);
+        size_t pos = 0;
+        char magic[4];
+        uint64_t hash;
+        uint32_t driverLength, format, length;
+        if (!readValue(data, &pos, magic) || std::string(magic, 4) != "CSPB" ||
+            !readValue(data, &pos, &hash) || hash != sourceHash ||
+            !readValue(data, &pos, &driverLength) || driverLength != driver.size() ||
+            data.size() - pos < driverLength || data.compare(pos, driverLength, driver) != 0) {
+            return 0;
+        }
+        pos += driverLength;
+        if (!readValue(data, &pos, &format) || !readValue(data, &pos, &length) || data.size() - pos < length) {
+            return 0;
+        }
+        
+        // ドライバが受け付けなければ (更新されたときなど) コンパイルし直す
+        GLuint programId = glCreateProgram();
+        glProgramBinary(programId, (GLenum)format, data.data() + pos, (GLsizei)length);
+        GLint linkState;
+        glGetProgramiv(programId, GL_LINK_STATUS, &linkState);
+        if (linkState == GL_FALSE) {
+            glDeleteProgram(programId);
+            return 0;
+        }
+        return programId;
+    }
+    
+    template <typename T>
+    static bool readValue(const std::string &data, size_t *pos, T *value) {
+        if (data.size() < *pos + sizeof(T)) {
+            return false;
+        }
+        memcpy(value, data.data() + *pos, sizeof(T));
+        *pos += sizeof(T);
+        return true;
+    }
+    
+    static void saveBinary(GLuint programId, const std::string &filename, const std::string &driver, uint64_t sourceHash) {
+        GLint length = 0;
+        glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> binary(length);
+        GLenum format;
+        glGetProgramBinary(programId, length, &length, &format, binary.data());
+        
+        FILE *fp = fopen(filename.c_str(), "wb");
+        if (!fp) {
+            return;
+        }
+        const uint32_t driverLength = (uint32_t)driver.size();
+        const uint32_t binaryFormat = (uint32_t)format;
+        const uint32_t binaryLength = (uint32_t)length;
+        fwrite("CSPB", 1, 4, fp);
+        fwrite(&sourceHash, sizeof(sourceHash), 1, fp);
+        fwrite(&driverLength, sizeof(driverLength), 1, fp);
+        fwrite(driver.data(), 1, driver.size(), fp);
+        fwrite(&binaryFormat, sizeof(binaryFormat), 1, fp);
+        fwrite(&binaryLength, sizeof(binaryLength), 1, fp);
+        fwrite(binary.data(), 1, binaryLength, fp);
+        fclose(fp);
+    }
+    
+    static GLuint compile(const std::string &vertFileData, const std::string &fragFileData) {
+        const char *vertShaderCode = vertFileData.c_str();
         const char *fragShaderCode = fragFileData.c_str();
         
+        // シェーダの用意
+        GLuint vertShaderId = glCreateShader(GL_VERTEX_SHADER);
+        GLuint fragShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+        
         // シェーダのコンパイル
         GLint compileStatus;
         glShaderSource(vertShaderId, 1, &vertShaderCode, NULL);
@@ -204,16 +588,17 @@ struct RenderObject {
                 glGetShaderInfoLog(fragShaderId, logLength, &length, errmsg);
                 
                 std::cerr << errmsg << std::endl;
-                fprintf(stderr, "%s", vertShaderCode);
+                fprintf(stderr, "%s", fragShaderCode);
                 
                 delete[] errmsg;
             }
         }
         
-        // シェーダプログラムの用意
-        programId = glCreateProgram();
+        // シェーダプログラムの用意 (リンクした結果をバイナリとして取り出せるようにする)
+        GLuint programId = glCreateProgram();
         glAttachShader(programId, vertShaderId);
         glAttachShader(programId, fragShaderId);
+        glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
         
         GLint linkState;
         glLinkProgram(programId);
@@ -234,154 +619,1339 @@ struct RenderObject {
             
             exit(1);
         }
+        
+        // リンクした後はシェーダ自体はいらない
+        glDetachShader(programId, vertShaderId);
+        glDetachShader(programId, fragShaderId);
+        glDeleteShader(vertShaderId);
+        glDeleteShader(fragShaderId);
+        return programId;
     }
+};
+
+ProgramCache programCache;
+
+
+// ビューごとの uniform (シェーダの ViewValues と同じ std140 の並び)
+struct ViewUniforms {
+    glm::mat4 viewMat;
+    glm::mat4 projMat;
+    glm::vec4 lightPosViewSpace;
+};
+
+// フレームごとの uniform (シェーダの FrameUniforms と同じ std140 の並び).
+// 描画命令1つが viewsPerDraw 個のインスタンスに増え, インスタンス i は viewBase + i % viewsPerDraw 番目のビューに描く
+struct FrameUniforms {
+    ViewUniforms views[MAX_VIEWS];
+    int viewsPerDraw;
+    int viewBase;
+    int padding[2];
+};
+
+// オブジェクトごとの uniform (シェーダの ObjectUniforms と同じ std140 の並び).
+// ビューによらない値だけを持ち, ビューの行列はシェーダでかける
+struct ObjectUniforms {
+    glm::mat4 modelMat;
+    glm::mat4 normModelMat;         // modelMat の逆行列の転置 (法線をワールド座標に移す)
+    glm::vec4 ambiColor;
+    glm::vec4 diffColor;
+    glm::vec4 specColor;
+    glm::vec4 positionOffset;       // 詰めた頂点を戻す係数 (VertexQuantization)
+    glm::vec4 positionScale;
+    glm::vec4 texcoordTransform;    // xy: offset, zw: scale
+    float shininess;
+    int isTextured;
+    int paletteIndex;
+    int padding;
     
-    void loadOBJ(const std::string &filename) {
-        // Load OBJ file.
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string err;
-        bool success = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename.c_str());
-        if (!err.empty()) {
-            std::cerr << "[WARNING] " << err << std::endl;
-        }
-        
-        if (!success) {
-            std::cerr << "Failed to load OBJ file: " << filename << std::endl;
-            exit(1);
+    void setQuantization(const VertexQuantization &q) {
+        positionOffset = glm::vec4(q.positionOffset[0], q.positionOffset[1], q.positionOffset[2], 0.0f);
+        positionScale = glm::vec4(q.positionScale[0], q.positionScale[1], q.positionScale[2], 1.0f);
+        texcoordTransform = glm::vec4(q.texcoordOffset[0], q.texcoordOffset[1], q.texcoordScale[0], q.texcoordScale[1]);
+    }
+};
+
+// カメラと光源の値. フレームの初めに1回書いて, 結合点に付けたままにしておく.
+// ビューごとに描き直すとき (bindPass) のために, viewBase だけが違う値を MAX_VIEWS 個並べておく
+struct FrameUniformBuffer {
+    GLuint bufferId;
+    GLsizeiptr blockSize;       // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT に揃えた1つ分の大きさ
+    
+    void initialize() {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        blockSize = ((GLsizeiptr)sizeof(FrameUniforms) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &bufferId);
+        glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+        glBufferData(GL_UNIFORM_BUFFER, blockSize * MAX_VIEWS, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        bindPass(0);
+    }
+    
+    // 1回の描画で viewsPerDraw 個のビューに描く (1 ならビューごとに bindPass で切り替えて描き直す)
+    void update(const std::vector<View> &views, int viewsPerDraw) {
+        std::vector<unsigned char> blocks(blockSize * MAX_VIEWS);
+        FrameUniforms values = FrameUniforms();
+        for (int v = 0; v < (int)views.size() && v < MAX_VIEWS; v++) {
+            const Camera &camera = views[v].camera;
+            values.views[v].viewMat = camera.viewMat;
+            values.views[v].projMat = camera.projMat;
+            values.views[v].lightPosViewSpace = camera.viewMat * glm::vec4(lightPos, 1.0f);
         }
-        
-        std::vector<Vertex> vertices;
-        std::vector<unsigned int> indices;
-        for (int s = 0; s < shapes.size(); s++) {
-            const tinyobj::shape_t &shape = shapes[s];
-            for (int i = 0; i < shape.mesh.indices.size(); i++) {
-                const tinyobj::index_t &index = shapes[s].mesh.indices[i];
-                
-                Vertex vertex;
-                if (index.vertex_index >= 0) {
-                    vertex.position = glm::vec3(
-                                                attrib.vertices[index.vertex_index * 3 + 0],
-                                                attrib.vertices[index.vertex_index * 3 + 1],
-                                                attrib.vertices[index.vertex_index * 3 + 2]
-                                                );
-                }
-                
-                if (index.normal_index >= 0) {
-                    vertex.normal = glm::vec3(
-                                              attrib.normals[index.normal_index * 3 + 0],
-                                              attrib.normals[index.normal_index * 3 + 1],
-                                              attrib.normals[index.normal_index * 3 + 2]
-                                              );
-                }
-                
-                if (index.texcoord_index >= 0) {
-                    vertex.texcoord = glm::vec2(
-                                                attrib.texcoords[index.texcoord_index * 2 + 0],
-                                                1.0f - attrib.texcoords[index.texcoord_index * 2 + 1]
-                                                );
-                }
-                
-                indices.push_back(vertices.size());
-                vertices.push_back(vertex);
-            }
+        values.viewsPerDraw = viewsPerDraw;
+        for (int p = 0; p < MAX_VIEWS; p++) {
+            values.viewBase = p;
+            memcpy(&blocks[blockSize * p], &values, sizeof(values));
         }
-        
-        // Prepare VAO.
-        glGenVertexArrays(1, &vaoId);
-        glBindVertexArray(vaoId);
-        
-        glGenBuffers(1, &vboId);
-        glBindBuffer(GL_ARRAY_BUFFER, vboId);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(),
-                     vertices.data(), GL_DYNAMIC_DRAW);
-        
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, texcoord));
-        
-        glGenBuffers(1, &iboId);
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, iboId);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
-                     indices.data(), GL_STATIC_DRAW);
-        bufferSize = indices.size();
-        
-        glBindVertexArray(0);
+        glBindBuffer(GL_UNIFORM_BUFFER, bufferId);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, blocks.size(), blocks.data());
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
     }
     
-    void loadTexture(const std::string &filename) {
-        int texWidth, texHeight, channels;
-        unsigned char *bytes = stbi_load(filename.c_str(), &texWidth, &texHeight, &channels, STBI_rgb_alpha);
-        if (!bytes) {
-            fprintf(stderr, "Failed to load image file: %s\n", filename.c_str());
-            exit(1);
+    void bindPass(int pass) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, bufferId, blockSize * pass, sizeof(FrameUniforms));
+    }
+    
+    void release() {
+        glDeleteBuffers(1, &bufferId);
+        bufferId = 0u;
+    }
+};
+
+// 毎フレーム書き換えるバッファ.
+// GL_ARB_buffer_storage があれば永続的にマップしておき, 書き込みは memcpy だけで済ませる.
+struct StreamBuffer {
+    GLenum target;
+    GLuint bufferId;
+    bool persistent;
+    unsigned char *mapped;
+    
+    void initialize(GLenum bufferTarget, GLsizeiptr size, bool usePersistent) {
+        target = bufferTarget;
+        persistent = usePersistent && GLEW_ARB_buffer_storage;
+        mapped = NULL;
+        glGenBuffers(1, &bufferId);
+        glBindBuffer(target, bufferId);
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(target, size, NULL, flags);
+            mapped = (unsigned char*)glMapBufferRange(target, 0, size, flags);
+        } else {
+            glBufferData(target, size, NULL, GL_DYNAMIC_DRAW);
         }
-        
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, textureId);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight,
-                     0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
-        
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        
-        glBindTexture(GL_TEXTURE_2D, 0);
-        
-        stbi_image_free(bytes);
+        glBindBuffer(target, 0);
     }
     
-    void draw(const Camera &camera) {
-        glUseProgram(programId);
-        
-        GLuint location;
-        location = glGetUniformLocation(programId, "u_ambColor");
-        glUniform3fv(location, 1, glm::value_ptr(ambiColor));
-        location = glGetUniformLocation(programId, "u_diffColor");
-        glUniform3fv(location, 1, glm::value_ptr(diffColor));
-        location = glGetUniformLocation(programId, "u_specColor");
-        glUniform3fv(location, 1, glm::value_ptr(specColor));
-        location = glGetUniformLocation(programId, "u_shininess");
-        glUniform1f(location, shininess);
-        
-        glm::mat4 mvMat, mvpMat, normMat;
-        mvMat = camera.viewMat * modelMat;
-        mvpMat = camera.projMat * mvMat;
-        normMat = glm::transpose(glm::inverse(mvMat));
-        
-        location = glGetUniformLocation(programId, "u_lightPos");
-        glUniform3fv(location, 1, glm::value_ptr(lightPos));
-        location = glGetUniformLocation(programId, "u_lightMat");
-        glUniformMatrix4fv(location, 1, false, glm::value_ptr(camera.viewMat));
-        location = glGetUniformLocation(programId, "u_mvMat");
-        glUniformMatrix4fv(location, 1, false, glm::value_ptr(mvMat));
-        location = glGetUniformLocation(programId, "u_mvpMat");
-        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mvpMat));
-        location = glGetUniformLocation(programId, "u_normMat");
-        glUniformMatrix4fv(location, 1, false, glm::value_ptr(normMat));
-        
-        if (textureId != 0) {
-            glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, textureId);
-            location = glGetUniformLocation(programId, "u_isTextured");
-            glUniform1i(location, 1);
-            location = glGetUniformLocation(programId, "u_texture");
-            glUniform1i(location, 0);
+    void write(GLintptr offset, const void *data, size_t size) {
+        if (persistent) {
+            memcpy(mapped + offset, data, size);
         } else {
-            location = glGetUniformLocation(programId, "u_isTextured");
-            glUniform1i(location, 0);
+            glBindBuffer(target, bufferId);
+            glBufferSubData(target, offset, size, data);
+            glBindBuffer(target, 0);
         }
-        
-        glBindVertexArray(vaoId);
-        glDrawElements(GL_TRIANGLES, bufferSize, GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-        
-        glUseProgram(0);
     }
-};
+    
+    void release() {
+        if (mapped) {
+            glBindBuffer(target, bufferId);
+            glUnmapBuffer(target);
+            glBindBuffer(target, 0);
+            mapped = NULL;
+        }
+        glDeleteBuffers(1, &bufferId);
+        bufferId = 0u;
+    }
+};
+
+// NUM_FRAMES フレーム分の領域を順番に使うためのフェンス.
+// GPU がまだ読んでいるかもしれない領域は, フェンスを待ってから使う.
+struct FrameFences {
+    static const int NUM_FRAMES = 3;
+    
+    int frame;
+    GLsync fences[NUM_FRAMES];
+    
+    void initialize() {
+        frame = 0;
+        std::fill(fences, fences + NUM_FRAMES, (GLsync)0);
+    }
+    
+    // 次の領域に移り, GPU がそこを読み終わるまで待つ
+    void beginFrame() {
+        frame = (frame + 1) % NUM_FRAMES;
+        if (fences[frame]) {
+            glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+        }
+    }
+    
+    void endFrame() {
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+    
+    void release() {
+        for (int f = 0; f < NUM_FRAMES; f++) {
+            if (fences[f]) {
+                glDeleteSync(fences[f]);
+                fences[f] = 0;
+            }
+        }
+    }
+};
+
+// オブジェクトごとの uniform を順に詰めていくリングバッファ.
+// 1フレームの分が足りなくなったら, 倍の大きさのバッファに作り直す
+struct UniformRing {
+    StreamBuffer buffer;
+    FrameFences fences;
+    GLsizeiptr slotSize;        // GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT に揃えた1つ分の大きさ
+    int slotsPerFrame;
+    int slot;
+    bool mapPersistent;         // 作り直すときも永続的にマップするか
+    
+    void initialize(int numSlots, size_t valueSize, bool usePersistent) {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        slotSize = ((GLsizeiptr)valueSize + alignment - 1) / alignment * alignment;
+        slotsPerFrame = numSlots;
+        slot = 0;
+        mapPersistent = usePersistent;
+        fences.initialize();
+        buffer.initialize(GL_UNIFORM_BUFFER, slotSize * slotsPerFrame * FrameFences::NUM_FRAMES, mapPersistent);
+    }
+    
+    // このフレームにあと count 個書けるようにする.
+    // 作り直すと, このフレームにそれまで書いた位置は使えなくなる (描画命令を出し終えたものは GL が古いバッファを残しておく).
+    // 書いた位置をまとめて後で使うときは, 書き始める前に必要な数を確保しておく
+    void reserve(int count) {
+        if (slot + count <= slotsPerFrame) {
+            return;
+        }
+        slotsPerFrame = std::max(2 * slotsPerFrame, count);
+        slot = 0;
+        buffer.release();
+        buffer.initialize(GL_UNIFORM_BUFFER, slotSize * slotsPerFrame * FrameFences::NUM_FRAMES, mapPersistent);
+    }
+    
+    void beginFrame() {
+        fences.beginFrame();
+        slot = 0;
+    }
+    
+    void endFrame() {
+        fences.endFrame();
+    }
+    
+    // 値を次の領域に書いて, その位置を返す (描くときに bindRange で結合点を向ける)
+    GLintptr write(const void *data, size_t size) {
+        reserve(1);
+        const GLintptr offset = slotSize * (fences.frame * slotsPerFrame + slot);
+        buffer.write(offset, data, size);
+        slot++;
+        return offset;
+    }
+    
+    void bindRange(GLuint binding, GLintptr offset, size_t size) {
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer.bufferId, offset, size);
+    }
+    
+    void release() {
+        fences.release();
+        buffer.release();
+    }
+};
+
+static const int OBJECT_UNIFORM_SLOTS = 256;   // 初めに確保する, 1フレームに描くオブジェクトの数 (足りなければ倍々で増やす)
+
+FrameUniformBuffer frameUniforms;
+UniformRing objectUniforms;
+
+
+// glMultiDrawElementsIndirect の描画命令1つ分 (GL の決めた並び)
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// バッファに書いた描画命令のまとまり1つ分 (ビューごとに描き直すときは同じものを何度でも描ける)
+struct IndirectRun {
+    GLintptr commandOffset;
+    GLintptr dataOffset;
+    GLsizeiptr dataSize;
+    GLsizei count;
+};
+
+// 同じ状態で続く描画命令を, 1回の glMultiDrawElementsIndirect でまとめて出すためのバッファ.
+// 描画命令は間接描画バッファに, オブジェクトごとの値 (ObjectUniforms) は SSBO に並べて書き,
+// シェーダ (*_indirect.vert) は gl_DrawIDARB で自分の値を読む.
+// GL 4.3 相当の機能と GL_ARB_shader_draw_parameters がなければ使わず, 1つずつ描く.
+struct IndirectDraws {
+    bool supported;
+    bool enabled;
+    StreamBuffer commandBuffer;
+    StreamBuffer dataBuffer;
+    FrameFences fences;
+    int drawsPerFrame;
+    GLsizeiptr dataAlignment;       // GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT
+    GLsizeiptr dataFrameSize;
+    int numDraws;                   // このフレームに書いた描画命令の数
+    GLsizeiptr dataCursor;          // このフレームの領域の中で, 次に値を書く位置
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<ObjectUniforms> values;
+    
+    void initialize(int maxDraws, bool allow) {
+        supported = (GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object)) &&
+                    GLEW_ARB_shader_draw_parameters;
+        enabled = allow && supported;
+        if (!supported) {
+            return;
+        }
+        
+        GLint alignment = 256;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        dataAlignment = alignment;
+        fences.initialize();
+        allocate(maxDraws);
+    }
+    
+    // 1フレームに maxDraws 個の描画命令を書けるバッファを作る
+    void allocate(int maxDraws) {
+        drawsPerFrame = maxDraws;
+        // まとまりごとに先頭を揃えるので, 揃えるための隙間の分も取っておく
+        dataFrameSize = ((GLsizeiptr)sizeof(ObjectUniforms) + dataAlignment) * drawsPerFrame;
+        numDraws = 0;
+        dataCursor = 0;
+        commandBuffer.initialize(GL_DRAW_INDIRECT_BUFFER,
+                                 sizeof(DrawElementsIndirectCommand) * drawsPerFrame * FrameFences::NUM_FRAMES, true);
+        dataBuffer.initialize(GL_SHADER_STORAGE_BUFFER, dataFrameSize * FrameFences::NUM_FRAMES, true);
+    }
+    
+    // このフレームにあと count 個の描画命令を書けるようにする (足りなければ倍の大きさで作り直す).
+    // 作り直すとそれまでに書いたまとまりは描けなくなるので, RenderQueue はフレームの分を書き始める前に呼ぶ
+    void reserve(int count) {
+        if (numDraws + count <= drawsPerFrame) {
+            return;
+        }
+        const int maxDraws = std::max(2 * drawsPerFrame, count);
+        commandBuffer.release();
+        dataBuffer.release();
+        allocate(maxDraws);
+    }
+    
+    void beginFrame() {
+        if (!supported) {
+            return;
+        }
+        fences.beginFrame();
+        numDraws = 0;
+        dataCursor = 0;
+    }
+    
+    void endFrame() {
+        if (!supported) {
+            return;
+        }
+        fences.endFrame();
+    }
+    
+    // 描画命令1つ分と, そのオブジェクトの値を積む
+    void add(const DrawElementsIndirectCommand &command, const ObjectUniforms &value) {
+        commands.push_back(command);
+        values.push_back(value);
+    }
+    
+    // 積んだ描画命令をバッファに書き, 描くときの位置を返す (足りる分は reserve で確保しておく)
+    IndirectRun flush() {
+        const int count = (int)commands.size();
+        const GLintptr commandOffset = sizeof(DrawElementsIndirectCommand) * (fences.frame * drawsPerFrame + numDraws);
+        commandBuffer.write(commandOffset, commands.data(), sizeof(DrawElementsIndirectCommand) * count);
+        
+        dataCursor = (dataCursor + dataAlignment - 1) / dataAlignment * dataAlignment;
+        const GLintptr dataOffset = dataFrameSize * fences.frame + dataCursor;
+        const GLsizeiptr dataSize = sizeof(ObjectUniforms) * count;
+        dataBuffer.write(dataOffset, values.data(), dataSize);
+        dataCursor += dataSize;
+        numDraws += count;
+        
+        commands.clear();
+        values.clear();
+        
+        IndirectRun run;
+        run.commandOffset = commandOffset;
+        run.dataOffset = dataOffset;
+        run.dataSize = dataSize;
+        run.count = count;
+        return run;
+    }
+    
+    // 書いておいたまとまりを1回でまとめて描く
+    void draw(const IndirectRun &run, GLenum indexType) {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, dataBuffer.bufferId, run.dataOffset, run.dataSize);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer.bufferId);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, indexType, (void*)run.commandOffset, run.count, 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    
+    void release() {
+        if (!supported) {
+            return;
+        }
+        fences.release();
+        commandBuffer.release();
+        dataBuffer.release();
+    }
+};
+
+IndirectDraws indirectDraws;
+
+
+// 色見本の画像を1つのテクスチャ配列にまとめたもの.
+// 色を変えるときは層の番号 (uniform) を変えるだけで, 画像の読み込みもテクスチャの作り直しもしない.
+struct Palette {
+    GLuint textureId;
+    int numColors;
+    
+    // 大きさの違う画像を同じ大きさに揃えて (最近傍で縮小・拡大) 1つのテクスチャ配列にする
+    void initialize(const std::vector<std::string> &filenames) {
+        static const int LAYER_SIZE = 64;
+        std::vector<unsigned char> layer(LAYER_SIZE * LAYER_SIZE * 4);
+        
+        // 色見本を使うシェーダは PALETTE_UNIT を見るので, そこに付けたままにしておく
+        numColors = (int)filenames.size();
+        glGenTextures(1, &textureId);
+        glActiveTexture(GL_TEXTURE0 + PALETTE_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, textureId);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, LAYER_SIZE, LAYER_SIZE, numColors,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        for (int l = 0; l < numColors; l++) {
+            int texWidth, texHeight, channels;
+            unsigned char *bytes = stbi_load(filenames[l].c_str(), &texWidth, &texHeight, &channels, STBI_rgb_alpha);
+            if (!bytes) {
+                fprintf(stderr, "Failed to load image file: %s\n", filenames[l].c_str());
+                exit(1);
+            }
+            for (int y = 0; y < LAYER_SIZE; y++) {
+                for (int x = 0; x < LAYER_SIZE; x++) {
+                    const unsigned char *src = bytes + ((y * texHeight / LAYER_SIZE) * texWidth + x * texWidth / LAYER_SIZE) * 4;
+                    std::copy(src, src + 4, &layer[(y * LAYER_SIZE + x) * 4]);
+                }
+            }
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, l, LAYER_SIZE, LAYER_SIZE, 1,
+                            GL_RGBA, GL_UNSIGNED_BYTE, layer.data());
+            stbi_image_free(bytes);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    
+    void release() {
+        glDeleteTextures(1, &textureId);
+        textureId = 0u;
+    }
+};
+
+Palette palette;
+
+
+// LOD の誤差が画面上でこのピクセル数より小さければ, 粗い LOD を使う
+static const float LOD_PIXEL_ERROR = 1.0f;
+
+// 誤差を画面に投影した大きさが LOD_PIXEL_ERROR ピクセル以下になる, 一番粗い LOD を選ぶ.
+// 誤差はメッシュの座標での距離なので, モデル行列の一番大きい拡大率をかけてから, モデルの原点の深さで割る.
+int pickLod(const std::vector<MeshLod> &lods, const glm::mat4 &modelMat, const View &view) {
+    const Camera &camera = view.camera;
+    float scale = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        const glm::vec4 &axis = modelMat[c];
+        scale = std::max(scale, std::sqrt(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z));
+    }
+    const glm::vec4 clipPos = camera.projMat * (camera.viewMat * (modelMat * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+    const float pixelsPerUnit = camera.projMat[1][1] * 0.5f * view.height / std::max(clipPos.w, 1.0e-3f);
+    
+    int level = 0;
+    for (size_t l = 1; l < lods.size(); l++) {
+        if (lods[l].error * scale * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+            level = (int)l;
+        }
+    }
+    return level;
+}
+
+// どのビューでも同じ LOD を描くので, 一番細かい LOD が要るビューに合わせる
+int pickLod(const std::vector<MeshLod> &lods, const glm::mat4 &modelMat, const std::vector<View> &views) {
+    int level = (int)lods.size() - 1;
+    for (size_t v = 0; v < views.size(); v++) {
+        level = std::min(level, pickLod(lods, modelMat, views[v]));
+    }
+    return level;
+}
+
+
+// 1フレームで視錐台カリングを通ったもの/捨てたものの数と, 描画命令と状態を切り替えた回数
+// (--stats で1秒ごとに平均を表示する). drawCalls は GL の描画関数を呼んだ回数で,
+// まとめて描いた描画命令は commands に1つずつ数える
+struct RenderStats {
+    int visible;
+    int culled;
+    int drawCalls;
+    int commands;
+    int programChanges;
+    int textureChanges;
+    int vaoChanges;
+    
+    void reset() {
+        visible = 0;
+        culled = 0;
+        drawCalls = 0;
+        commands = 0;
+        programChanges = 0;
+        textureChanges = 0;
+        vaoChanges = 0;
+    }
+    
+    void add(const RenderStats &other) {
+        visible += other.visible;
+        culled += other.culled;
+        drawCalls += other.drawCalls;
+        commands += other.commands;
+        programChanges += other.programChanges;
+        textureChanges += other.textureChanges;
+        vaoChanges += other.vaoChanges;
+    }
+};
+
+RenderStats renderStats;
+
+
+// カメラの視錐台. 平面は projMat * viewMat の行から取り出し, 法線を内向きにして正規化しておく
+struct Frustum {
+    glm::vec4 planes[6];
+    
+    explicit Frustum(const Camera &camera) {
+        const glm::mat4 m = camera.projMat * camera.viewMat;
+        for (int i = 0; i < 3; i++) {
+            for (int s = 0; s < 2; s++) {
+                const float sign = s == 0 ? 1.0f : -1.0f;
+                glm::vec4 &plane = planes[i * 2 + s];
+                for (int k = 0; k < 4; k++) {
+                    plane[k] = m[k][3] + sign * m[k][i];
+                }
+                const float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+                plane = plane * (1.0f / length);
+            }
+        }
+    }
+    
+    // modelMat で動かしたメッシュが見えるかもしれなければ true.
+    // 境界球と (モデル行列で回した) 箱のうち, 平面の法線の向きに薄い方で判定する
+    bool intersects(const MeshBounds &bounds, const glm::mat4 &modelMat) const {
+        const glm::vec4 center = modelMat * glm::vec4(bounds.center[0], bounds.center[1], bounds.center[2], 1.0f);
+        glm::vec3 axes[3];
+        float scale = 0.0f;
+        for (int c = 0; c < 3; c++) {
+            const float halfExtent = 0.5f * (bounds.max[c] - bounds.min[c]);
+            axes[c] = glm::vec3(modelMat[c].x, modelMat[c].y, modelMat[c].z);
+            scale = std::max(scale, glm::length(axes[c]));
+            axes[c] = axes[c] * halfExtent;
+        }
+        const float sphereRadius = bounds.radius * scale;
+        
+        for (int p = 0; p < 6; p++) {
+            const glm::vec3 normal(planes[p].x, planes[p].y, planes[p].z);
+            const float distance = normal.x * center.x + normal.y * center.y + normal.z * center.z + planes[p].w;
+            float boxRadius = 0.0f;
+            for (int c = 0; c < 3; c++) {
+                boxRadius += std::fabs(glm::dot(normal, axes[c]));
+            }
+            if (distance < -std::min(sphereRadius, boxRadius)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// どれか1つのビューの視錐台に入っていれば見える
+bool intersectsAny(const std::vector<Frustum> &frustums, const MeshBounds &bounds, const glm::mat4 &modelMat) {
+    for (size_t f = 0; f < frustums.size(); f++) {
+        if (frustums[f].intersects(bounds, modelMat)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// 描く順番の大きな区切り. 区切りごとに深度テストとブレンドの設定が決まっている
+enum {
+    LAYER_BACKGROUND,       // 深度を比べずに書く (背景. ビューの深度の範囲の一番奥に置く)
+    LAYER_OPAQUE,           // 深度テストあり
+    LAYER_OVERLAY,          // 深度テストなし, アルファブレンド (スタート画面)
+};
+
+void applyLayerState(int layer) {
+    if (layer == LAYER_OVERLAY) {
+        glDisable(GL_DEPTH_TEST);
+    } else {
+        glEnable(GL_DEPTH_TEST);
+    }
+    glDepthFunc(layer == LAYER_BACKGROUND ? GL_ALWAYS : GL_LESS);
+    if (layer == LAYER_OVERLAY) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glDisable(GL_BLEND);
+    }
+}
+
+// 頂点シェーダで gl_ViewportIndex を書けるか (initializeGL で調べる).
+// 書ければ, 複数のビューを1回の描画で描く
+bool layeredViews = false;
+
+// 1回の描画で numViews 個のビューに描くときの, ビューごとのビューポートと深度の範囲
+void setLayeredViewports(const std::vector<View> &views, int numViews) {
+    for (int v = 0; v < numViews; v++) {
+        glViewportIndexedf(v, (float)views[v].x, (float)views[v].y, (float)views[v].width, (float)views[v].height);
+        glDepthRangeIndexed(v, views[v].depthNear, views[v].depthFar);
+    }
+}
+
+// 1つのビューだけに描くときのビューポートと深度の範囲
+void setViewport(const View &view) {
+    glViewport(view.x, view.y, view.width, view.height);
+    glDepthRange(view.depthNear, view.depthFar);
+}
+
+// 描き終わったらフレームバッファ全体に戻す
+void resetViewport() {
+    glViewport(0, 0, FB_WIDTH, FB_HEIGHT);
+    glDepthRange(0.0, 1.0);
+}
+
+// ボールのインスタンスごとの属性 (3〜7) を first 番目のインスタンスから読ませる (VAO をバインドしてから呼ぶ).
+// glDrawElementsInstancedBaseInstance (4.2) が使えなくても LOD ごとに描けるようにする.
+// 1回の描画で複数のビューに描くときは, divisor 個 (ビューの数) のインスタンスで同じ値を使う.
+void setInstanceAttributes(GLuint instanceVboId, int first, int divisor);
+
+// 描画命令1つ分. オブジェクトごとの値は, 描くときに並べ替えた順で uniform のリングか SSBO に書く
+struct DrawItem {
+    int layer;
+    GLuint programId;
+    GLuint indirectProgramId;   // 0 でなければ, 同じ状態の描画命令とまとめて描くときに使う
+    GLuint textureId;           // 0 ならテクスチャを使わない
+    GLuint vaoId;
+    GLenum indexType;
+    GLsizei indexCount;
+    GLuint firstIndex;          // 区画の中のインデックスの番号
+    GLint baseVertex;
+    GLuint instanceVboId;       // 0 でなければ instanceCount 個のインスタンスを描く
+    int firstInstance;
+    GLsizei instanceCount;
+    ObjectUniforms values;
+    
+    bool indirect() const {
+        return indirectDraws.enabled && indirectProgramId != 0;
+    }
+    
+    // 1回の glMultiDrawElementsIndirect にまとめられるか
+    bool batchesWith(const DrawItem &other) const {
+        return indirect() && other.indirect() && layer == other.layer &&
+               indirectProgramId == other.indirectProgramId && textureId == other.textureId &&
+               vaoId == other.vaoId && indexType == other.indexType && instanceVboId == other.instanceVboId;
+    }
+};
+
+// 1フレーム分の描画命令を集め, ソートキーの順に並べ替えてから出す.
+// キーは上の桁から 区切り (4 ビット) / プログラム (10) / テクスチャ (12) / VAO (12) / 深度 (24) なので,
+// 同じ状態の描画命令が隣り合い, 同じ状態の中では手前から描く. 直前と同じ状態のバインドは省く.
+// 間接描画が使えれば, 同じ状態で続く描画命令は1回の glMultiDrawElementsIndirect にまとめる.
+struct RenderQueue {
+    // 1回の描画で出すもの. 間接描画なら run にまとめた描画命令, そうでなければ uniform のリングの位置を持つ
+    struct Batch {
+        uint32_t item;              // 状態を決める (先頭の) 描画命令
+        GLintptr uniformOffset;
+        IndirectRun run;
+    };
+    
+    std::vector<DrawItem> items;
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> order;
+    std::vector<uint64_t> keyBuffer;
+    std::vector<uint32_t> orderBuffer;
+    std::vector<Batch> batches;
+    
+    // viewDepth はカメラからの深さ (手前ほど小さい)
+    void push(const DrawItem &item, float viewDepth) {
+        // 正の float はビット列の大小と値の大小が同じなので, 上の 24 ビットをそのまま使う
+        const float depth = std::max(viewDepth, 0.0f);
+        uint32_t depthBits;
+        memcpy(&depthBits, &depth, sizeof(depthBits));
+        
+        const uint64_t key = ((uint64_t)(item.layer & 0xf) << 60) |
+                             ((uint64_t)(item.programId & 0x3ff) << 50) |
+                             ((uint64_t)(item.textureId & 0xfff) << 38) |
+                             ((uint64_t)(item.vaoId & 0xfff) << 26) |
+                             (uint64_t)(depthBits >> 8);
+        items.push_back(item);
+        keys.push_back(key);
+    }
+    
+    // 8 ビットずつの LSD 基数ソート. すべてのキーで同じ桁は飛ばす
+    void sort() {
+        order.resize(items.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = (uint32_t)i;
+        }
+        keyBuffer.resize(keys.size());
+        orderBuffer.resize(order.size());
+        
+        for (int shift = 0; shift < 64; shift += 8) {
+            size_t counts[257] = { 0 };
+            for (size_t i = 0; i < keys.size(); i++) {
+                counts[((keys[i] >> shift) & 0xff) + 1]++;
+            }
+            if (keys.empty() || counts[((keys[0] >> shift) & 0xff) + 1] == keys.size()) {
+                continue;
+            }
+            for (int b = 0; b < 256; b++) {
+                counts[b + 1] += counts[b];
+            }
+            for (size_t i = 0; i < keys.size(); i++) {
+                const size_t dst = counts[(keys[i] >> shift) & 0xff]++;
+                keyBuffer[dst] = keys[i];
+                orderBuffer[dst] = order[i];
+            }
+            keys.swap(keyBuffer);
+            order.swap(orderBuffer);
+        }
+    }
+    
+    // 並べ替えた描画命令を views のビューすべてに描き, キューを空にする.
+    // 並べ替えとオブジェクトごとの値の書き込みは1回だけで, ビューの数によらない.
+    // 頂点シェーダでビューポートを選べれば, 描画命令をビューの数のインスタンスに増やして1回で全部のビューに描く.
+    // できなければ, ビューごとにビューポートと frameUniforms の区画を切り替えて同じ描画命令を出し直す.
+    // 終わったら深度テストありの状態と, フレームバッファ全体のビューポートに戻しておく
+    void execute(const std::vector<View> &views) {
+        sort();
+        
+        const int numViews = std::min((int)views.size(), MAX_VIEWS);
+        const bool layered = numViews > 1 && layeredViews;
+        const int viewsPerDraw = layered ? numViews : 1;
+        prepare(viewsPerDraw);
+        frameUniforms.update(views, viewsPerDraw);
+        
+        if (layered) {
+            setLayeredViewports(views, numViews);
+            frameUniforms.bindPass(0);
+            drawBatches(viewsPerDraw);
+        } else {
+            for (int v = 0; v < numViews; v++) {
+                setViewport(views[v]);
+                frameUniforms.bindPass(v);
+                drawBatches(1);
+            }
+        }
+        glBindVertexArray(0);
+        glUseProgram(0);
+        applyLayerState(LAYER_OPAQUE);
+        resetViewport();
+        frameUniforms.bindPass(0);
+        
+        items.clear();
+        keys.clear();
+        batches.clear();
+    }
+    
+    // 並べ替えた順にまとまりを作り, オブジェクトごとの値と間接描画の描画命令をバッファに書く
+    void prepare(int viewsPerDraw) {
+        batches.clear();
+        // 書いた位置は描くまで取っておくので, 途中で作り直さないように先に確保する
+        if (indirectDraws.enabled) {
+            indirectDraws.reserve((int)items.size());
+        }
+        objectUniforms.reserve((int)items.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            const DrawItem &item = items[order[i]];
+            Batch batch;
+            batch.item = order[i];
+            batch.uniformOffset = 0;
+            
+            if (item.indirect()) {
+                size_t end = i;
+                for (; end < order.size() && item.batchesWith(items[order[end]]); end++) {
+                    const DrawItem &batched = items[order[end]];
+                    DrawElementsIndirectCommand command;
+                    command.count = batched.indexCount;
+                    command.instanceCount = (batched.instanceVboId != 0 ? batched.instanceCount : 1) * viewsPerDraw;
+                    command.firstIndex = batched.firstIndex;
+                    command.baseVertex = batched.baseVertex;
+                    command.baseInstance = batched.instanceVboId != 0 ? batched.firstInstance : 0;
+                    indirectDraws.add(command, batched.values);
+                }
+                batch.run = indirectDraws.flush();
+                i = end - 1;
+            } else {
+                batch.uniformOffset = objectUniforms.write(&item.values, sizeof(ObjectUniforms));
+                batch.run.count = 1;
+            }
+            batches.push_back(batch);
+        }
+    }
+    
+    // prepare で書いたまとまりを順に描く. 直前と同じ状態のバインドは省く
+    void drawBatches(int viewsPerDraw) {
+        int layer = -1;
+        GLuint programId = 0u;
+        GLuint textureId = 0u;
+        GLuint vaoId = 0u;
+        for (size_t b = 0; b < batches.size(); b++) {
+            const Batch &batch = batches[b];
+            const DrawItem &item = items[batch.item];
+            const GLuint itemProgramId = item.indirect() ? item.indirectProgramId : item.programId;
+            if (item.layer != layer) {
+                applyLayerState(item.layer);
+                layer = item.layer;
+            }
+            if (itemProgramId != programId) {
+                glUseProgram(itemProgramId);
+                programId = itemProgramId;
+                renderStats.programChanges++;
+            }
+            // 色見本は PALETTE_UNIT に付けたままにしてある
+            if (item.textureId != 0 && item.textureId != textureId) {
+                glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+                glBindTexture(GL_TEXTURE_2D, item.textureId);
+                textureId = item.textureId;
+                renderStats.textureChanges++;
+            }
+            if (item.vaoId != vaoId) {
+                glBindVertexArray(item.vaoId);
+                vaoId = item.vaoId;
+                renderStats.vaoChanges++;
+            }
+            renderStats.drawCalls++;
+            renderStats.commands += batch.run.count;
+            
+            if (item.indirect()) {
+                // インスタンスの属性は baseInstance でずらすので, 先頭から読ませておけばよい
+                if (item.instanceVboId != 0) {
+                    setInstanceAttributes(item.instanceVboId, 0, viewsPerDraw);
+                }
+                indirectDraws.draw(batch.run, item.indexType);
+                continue;
+            }
+            
+            objectUniforms.bindRange(OBJECT_UNIFORMS_BINDING, batch.uniformOffset, sizeof(ObjectUniforms));
+            const void *indexOffset = (void*)(item.firstIndex * indexSize(item.indexType));
+            if (item.instanceVboId != 0) {
+                setInstanceAttributes(item.instanceVboId, item.firstInstance, viewsPerDraw);
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, indexOffset,
+                                                  item.instanceCount * viewsPerDraw, item.baseVertex);
+            } else if (viewsPerDraw > 1) {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, indexOffset,
+                                                  viewsPerDraw, item.baseVertex);
+            } else {
+                glDrawElementsBaseVertex(GL_TRIANGLES, item.indexCount, item.indexType, indexOffset, item.baseVertex);
+            }
+        }
+    }
+};
+
+RenderQueue renderQueue;
+
+
+struct RenderObject {
+    GLuint programId;
+    GLuint indirectProgramId;   // まとめて描くときのプログラム (0 なら1つずつ描く)
+    GLuint vaoId;
+    GLuint vboId;
+    GLuint iboId;
+    GLuint textureId;
+    int paletteIndex;       // 色見本の層の番号 (負ならテクスチャを使う)
+    int bufferSize;
+    GLenum indexType;
+    GLint baseVertex;
+    std::vector<MeshLod> lods;
+    VertexQuantization quantization;
+    MeshBounds bounds;
+    bool screenSpace;       // 頂点をそのまま画面に置く (texture.vert) ので, カリングしない
+    bool visible;           // 最後のカリングで見えるとされたか
+    int layer;
+    
+    glm::mat4 modelMat;
+    glm::vec3 ambiColor;
+    glm::vec3 diffColor;
+    glm::vec3 specColor;
+    float shininess;
+    
+    void initialize() {
+        programId = 0u;
+        indirectProgramId = 0u;
+        vaoId = 0u;
+        vboId = 0u;
+        iboId = 0u;
+        textureId = 0u;
+        paletteIndex = -1;
+        bufferSize = 0;
+        indexType = GL_UNSIGNED_INT;
+        baseVertex = 0;
+        screenSpace = false;
+        visible = true;
+        layer = LAYER_OPAQUE;
+        
+        ambiColor = glm::vec3(0.0f, 0.0f, 0.0f);
+        diffColor = glm::vec3(1.0f, 1.0f, 1.0f);
+        specColor = glm::vec3(0.0f, 0.0f, 0.0f);
+    }
+    
+    // シェーダはキャッシュから共有する (同じ名前のプログラムは1回しかコンパイルしない).
+    // 間接描画が使えて, まとめて描くためのシェーダ (indirectBasename) があれば, それも用意しておく
+    void buildShader(const std::string &basename, const std::string &indirectBasename = std::string()) {
+        programId = programCache.get(basename);
+        if (indirectDraws.supported && !indirectBasename.empty()) {
+            indirectProgramId = programCache.get(indirectBasename);
+        }
+    }
+    
+    // メッシュはキャッシュから共有する (同じ OBJ ファイルは1回しか読み込まない)
+    void loadOBJ(const std::string &filename) {
+        const Mesh &mesh = meshCache.get(filename);
+        vaoId = mesh.vaoId;
+        vboId = mesh.vboId;
+        iboId = mesh.iboId;
+        bufferSize = mesh.bufferSize;
+        indexType = mesh.indexType;
+        baseVertex = mesh.baseVertex;
+        lods = mesh.lods;
+        quantization = mesh.quantization;
+        bounds = mesh.bounds;
+    }
+    
+    // どのビューの視錐台からも外れていれば, 次のカリングまで submit では何も積まない
+    void cull(const std::vector<Frustum> &frustums) {
+        visible = screenSpace || intersectsAny(frustums, bounds, modelMat);
+        if (visible) {
+            renderStats.visible++;
+        } else {
+            renderStats.culled++;
+        }
+    }
+    
+    void loadTexture(const std::string &filename) {
+        int texWidth, texHeight, channels;
+        unsigned char *bytes = stbi_load(filename.c_str(), &texWidth, &texHeight, &channels, STBI_rgb_alpha);
+        if (!bytes) {
+            fprintf(stderr, "Failed to load image file: %s\n", filename.c_str());
+            exit(1);
+        }
+        
+        glGenTextures(1, &textureId);
+        glBindTexture(GL_TEXTURE_2D, textureId);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, texWidth, texHeight,
+                     0, GL_RGBA, GL_UNSIGNED_BYTE, bytes);
+        
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        
+        glBindTexture(GL_TEXTURE_2D, 0);
+        
+        stbi_image_free(bytes);
+    }
+    
+    // ビューの行列と光源の値は frameUniforms に書いてあるものを使う (描くのは queue.execute() のとき).
+    // 全部のビューで同じ描画命令を使うので, LOD は一番細かいものが要るビューに合わせ, 並べ替えの深さは最初のビューで測る
+    void submit(RenderQueue &queue, const std::vector<View> &views) {
+        if (!visible) {
+            return;
+        }
+        
+        ObjectUniforms values;
+        values.modelMat = modelMat;
+        values.normModelMat = glm::transpose(glm::inverse(modelMat));
+        values.ambiColor = glm::vec4(ambiColor, 1.0f);
+        values.diffColor = glm::vec4(diffColor, 1.0f);
+        values.specColor = glm::vec4(specColor, 1.0f);
+        values.setQuantization(quantization);
+        values.shininess = shininess;
+        values.isTextured = textureId != 0 ? 1 : 0;
+        values.paletteIndex = paletteIndex;
+        values.padding = 0;
+        
+        const MeshLod &lod = lods[pickLod(lods, modelMat, views)];
+        DrawItem item;
+        item.layer = layer;
+        item.programId = programId;
+        item.indirectProgramId = indirectProgramId;
+        item.textureId = textureId;
+        item.vaoId = vaoId;
+        item.indexType = indexType;
+        item.indexCount = lod.indexCount;
+        item.firstIndex = lod.firstIndex;
+        item.baseVertex = baseVertex;
+        item.instanceVboId = 0u;
+        item.firstInstance = 0;
+        item.instanceCount = 0;
+        item.values = values;
+        
+        const glm::vec4 viewPos = views[0].camera.viewMat * (modelMat * glm::vec4(bounds.center[0], bounds.center[1], bounds.center[2], 1.0f));
+        queue.push(item, -viewPos.z);
+    }
+};
+
+
+// インスタンスごとの値 (render_instanced.vert の属性 3〜7)
+struct BallInstance {
+    glm::mat4 modelMat;
+    float colorIndex;
+};
+
+// 転がっているボールを1回の glDrawElementsInstanced でまとめて描く.
+// メッシュは1つだけ持ち, 色は色見本の層をインスタンスごとに選ぶ.
+struct InstancedBalls {
+    RenderObject mesh;
+    GLuint vaoId;
+    StreamBuffer instanceBuffer;    // NUM_FRAMES フレーム分の領域を順に使う (軌跡と同じ)
+    FrameFences fences;
+    int instancesPerFrame;
+    int frameFirst;                 // このフレームの領域の先頭のインスタンス
+    std::vector<BallInstance> instances;
+    std::vector<BallInstance> visibleInstances;    // カリングを通ったもの
+    std::vector<BallInstance> sortedInstances;     // visibleInstances を LOD の順に並べ替えたもの
+    
+    void initialize(const std::string &objfile) {
+        mesh.initialize();
+        mesh.loadOBJ(objfile);
+        mesh.buildShader(INSTANCED_SHADER, INSTANCED_INDIRECT_SHADER);
+        mesh.shininess = 1.0f;
+        
+        // 共有している区画の VAO は変えずに, インスタンスごとの属性を足した VAO を別に作る
+        // (インスタンスのバッファは描くときに setInstanceAttributes で付ける)
+        glGenVertexArrays(1, &vaoId);
+        glBindVertexArray(vaoId);
+        meshCache.get(objfile).arena->bindAttributes();
+        for (int c = 0; c < 4; c++) {
+            glEnableVertexAttribArray(3 + c);
+        }
+        glEnableVertexAttribArray(7);
+        glBindVertexArray(0);
+        
+        fences.initialize();
+        instancesPerFrame = 0;
+        frameFirst = 0;
+        reserve(64);
+    }
+    
+    // 1フレームに numInstances 個を書けるようにする (足りていれば何もしない).
+    // 作り直した後のバッファを GPU はまだ読んでいないので, フェンスはそのまま使い続けてよい
+    void reserve(int numInstances) {
+        if (numInstances <= instancesPerFrame) {
+            return;
+        }
+        if (instancesPerFrame > 0) {
+            instanceBuffer.release();
+        }
+        instancesPerFrame = std::max(numInstances, 2 * instancesPerFrame);
+        instanceBuffer.initialize(GL_ARRAY_BUFFER, sizeof(BallInstance) * instancesPerFrame * FrameFences::NUM_FRAMES, true);
+    }
+    
+    void beginFrame() {
+        fences.beginFrame();
+    }
+    
+    void endFrame() {
+        fences.endFrame();
+    }
+    
+    // インスタンスの値をこのフレームの領域に書く (永続的にマップしていれば memcpy だけ)
+    void upload(const std::vector<BallInstance> &values) {
+        reserve((int)values.size());
+        frameFirst = instancesPerFrame * fences.frame;
+        instanceBuffer.write(sizeof(BallInstance) * frameFirst, values.data(), sizeof(BallInstance) * values.size());
+    }
+    
+    void release() {
+        fences.release();
+        instanceBuffer.release();
+        glDeleteVertexArrays(1, &vaoId);
+        vaoId = 0u;
+        instancesPerFrame = 0;
+    }
+    
+    // どのビューの視錐台からも外れたボール (円盤から落ちていったものなど) を除く
+    void cull(const std::vector<Frustum> &frustums) {
+        visibleInstances.clear();
+        for (size_t i = 0; i < instances.size(); i++) {
+            if (intersectsAny(frustums, mesh.bounds, instances[i].modelMat)) {
+                visibleInstances.push_back(instances[i]);
+            }
+        }
+        renderStats.visible += (int)visibleInstances.size();
+        renderStats.culled += (int)(instances.size() - visibleInstances.size());
+    }
+    
+    // 見えるボールごとに LOD を選び, 同じ LOD のボールをまとめて1回ずつ描く.
+    // インスタンスのバッファはフレームに1回だけ書き, 全部のビューで使う
+    void submit(RenderQueue &queue, const std::vector<View> &views) {
+        if (visibleInstances.empty()) {
+            return;
+        }
+        
+        const std::vector<MeshLod> &lods = mesh.lods;
+        std::vector<int> levels(visibleInstances.size());
+        std::vector<int> counts(lods.size(), 0);
+        for (size_t i = 0; i < visibleInstances.size(); i++) {
+            levels[i] = pickLod(lods, visibleInstances[i].modelMat, views);
+            counts[levels[i]]++;
+        }
+        sortedInstances.clear();
+        for (size_t l = 0; l < lods.size(); l++) {
+            for (size_t i = 0; i < visibleInstances.size(); i++) {
+                if (levels[i] == (int)l) {
+                    sortedInstances.push_back(visibleInstances[i]);
+                }
+            }
+        }
+        upload(sortedInstances);
+        
+        // 行列はインスタンスごとの属性で送るので, 材質だけを使う
+        ObjectUniforms values;
+        values.ambiColor = glm::vec4(mesh.ambiColor, 1.0f);
+        values.diffColor = glm::vec4(mesh.diffColor, 1.0f);
+        values.specColor = glm::vec4(mesh.specColor, 1.0f);
+        values.setQuantization(mesh.quantization);
+        values.shininess = mesh.shininess;
+        values.isTextured = 0;
+        values.paletteIndex = -1;
+        values.padding = 0;
+        
+        DrawItem item;
+        item.layer = LAYER_OPAQUE;
+        item.programId = mesh.programId;
+        item.indirectProgramId = mesh.indirectProgramId;
+        item.textureId = 0u;
+        item.vaoId = vaoId;
+        item.indexType = mesh.indexType;
+        item.baseVertex = mesh.baseVertex;
+        item.instanceVboId = instanceBuffer.bufferId;
+        item.values = values;
+        
+        int first = frameFirst;
+        for (size_t l = 0; l < lods.size(); l++) {
+            if (counts[l] == 0) {
+                continue;
+            }
+            item.indexCount = lods[l].indexCount;
+            item.firstIndex = lods[l].firstIndex;
+            item.firstInstance = first;
+            item.instanceCount = counts[l];
+            queue.push(item, 0.0f);
+            first += counts[l];
+        }
+    }
+};
+
+void setInstanceAttributes(GLuint instanceVboId, int first, int divisor) {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVboId);
+    const size_t base = sizeof(BallInstance) * first;
+    for (int c = 0; c < 4; c++) {
+        glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(BallInstance),
+                              (void*)(base + offsetof(BallInstance, modelMat) + sizeof(glm::vec4) * c));
+        glVertexAttribDivisor(3 + c, divisor);
+    }
+    glVertexAttribPointer(7, 1, GL_FLOAT, GL_FALSE, sizeof(BallInstance), (void*)(base + offsetof(BallInstance, colorIndex)));
+    glVertexAttribDivisor(7, divisor);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+// 軌跡の頂点 (trail.vert の属性 0, 1). TrailHistory::write で書く並びと同じ
+struct TrailVertex {
+    float position[3];      // 円盤に固定した座標系での位置
+    float age;              // いまの位置が 0, 一番古い位置が 1
+};
+
+// 転がっているボールの軌跡 (直前の位置の列) を, 線分の列 (GL_LINES) にしてまとめて1回で描く.
+// 位置はシミュレーションを1ステップ進めるごとに覚えるので, 点の間隔と軌跡の長さはフレームレートによらない.
+// 頂点は毎フレーム, 永続的にマップしたバッファ (StreamBuffer) のこのフレームの領域に直接書き,
+// その領域を GPU が読み終わったかは FrameFences で確かめる. バッファは足りなくなったときだけ倍の大きさで作り直す.
+// 位置は円盤に固定した座標系で覚えておき, 描くときに円盤の回転をかけるので, 円盤から見た曲がり方 (コリオリ力) が残る.
+struct TrailRenderer {
+    GLuint programId;
+    GLuint vaoId;
+    StreamBuffer buffer;
+    FrameFences fences;
+    int verticesPerFrame;
+    TrailHistory history;
+    glm::vec4 color;
+    std::vector<float> positions;       // record で使う, ボールの位置 (x, y, z) の並び
+    std::vector<float> heads;           // 描くときのボールの位置 (円盤の座標系. 軌跡の先端をここに合わせる)
+    std::vector<TrailVertex> points;    // 1本の軌跡の点を古い順に並べたもの
+    std::vector<TrailVertex> staging;   // 永続的にマップできないときは, ここに並べてから1回で送る
+    GLint first;                        // このフレームの線分の先頭の頂点と頂点の数
+    GLsizei count;
+    int numDrawn;                       // 線分にした軌跡の数
+    
+    void initialize(int length) {
+        programId = programCache.get(TRAIL_SHADER);
+        history = TrailHistory(length);
+        color = glm::vec4(1.0f, 0.9f, 0.5f, 0.8f);
+        fences.initialize();
+        glGenVertexArrays(1, &vaoId);
+        verticesPerFrame = 0;
+        points.resize(length);
+        reserve((size_t)2 * length * 64);
+    }
+    
+    // 1フレームに numVertices 個の頂点を書けるようにする (足りていれば何もしない).
+    // 作り直した後のバッファを GPU はまだ読んでいないので, フェンスはそのまま使い続けてよい
+    void reserve(size_t numVertices) {
+        if (numVertices <= (size_t)verticesPerFrame) {
+            return;
+        }
+        if (verticesPerFrame > 0) {
+            buffer.release();
+        }
+        verticesPerFrame = (int)std::max(numVertices, (size_t)2 * verticesPerFrame);
+        buffer.initialize(GL_ARRAY_BUFFER, sizeof(TrailVertex) * (size_t)verticesPerFrame * FrameFences::NUM_FRAMES, true);
+        
+        glBindVertexArray(vaoId);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer.bufferId);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(TrailVertex), (void*)offsetof(TrailVertex, age));
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    
+    void beginFrame() {
+        fences.beginFrame();
+    }
+    
+    void endFrame() {
+        fences.endFrame();
+    }
+    
+    // 生きているボールの位置を円盤に固定した座標系に直して, alpha 倍だけ進めた時刻の位置を pos に並べる
+    static void diskPositions(const Lane &lane, float alpha, std::vector<float> *pos) {
+        const glm::mat4 toDisk = glm::rotate(-lane.renderTheta(alpha), glm::vec3(0.0f, 1.0f, 0.0f));
+        pos->resize(lane.numBalls() * 3);
+        for (int i = 0; i < lane.numBalls(); i++) {
+            glm::vec3 p;
+            lane.renderBallPosition(i, alpha, &p[0]);
+            const glm::vec4 local = toDisk * glm::vec4(p, 1.0f);
+            (*pos)[i * 3 + 0] = local.x;
+            (*pos)[i * 3 + 1] = local.y;
+            (*pos)[i * 3 + 2] = local.z;
+        }
+    }
+    
+    // シミュレーションを1ステップ進めるごとに, 生きているボールの位置を1つずつ足す
+    void record(const Lane &lane) {
+        diskPositions(lane, 1.0f, &positions);
+        history.record(lane.balls().handles(), lane.numBalls(), positions.data());
+    }
+    
+    // 描くときのボールの位置 (ステップの間を補間したもの) を覚えておき, 軌跡の先端をそこに合わせる
+    void setHeads(const Lane &lane, float alpha) {
+        diskPositions(lane, alpha, &heads);
+    }
+    
+    // 軌跡の頂点を, 隣り合う点を結ぶ線分ごとに2つずつ, このフレームの領域に書く (描く前に1回だけ呼ぶ)
+    void upload() {
+        count = 0;
+        numDrawn = 0;
+        reserve((size_t)2 * history.totalPoints());
+        
+        first = verticesPerFrame * fences.frame;
+        TrailVertex *vertices;
+        if (buffer.persistent) {
+            vertices = (TrailVertex*)buffer.mapped + first;
+        } else {
+            staging.resize((size_t)2 * history.totalPoints());
+            vertices = staging.data();
+        }
+        for (int i = 0; i < history.numTrails(); i++) {
+            // 点が1つだけの軌跡 (投げた直後) は線にならない
+            const int n = history.write(i, &points[0].position[0]);
+            if (n < 2) {
+                continue;
+            }
+            if ((i + 1) * 3 <= (int)heads.size()) {
+                std::copy(&heads[i * 3], &heads[i * 3 + 3], points[n - 1].position);
+            }
+            for (int k = 0; k + 1 < n; k++) {
+                vertices[count++] = points[k];
+                vertices[count++] = points[k + 1];
+            }
+            numDrawn++;
+        }
+        if (!buffer.persistent && count > 0) {
+            buffer.write(sizeof(TrailVertex) * first, staging.data(), sizeof(TrailVertex) * count);
+        }
+    }
+    
+    // upload で書いた軌跡を描く (modelMat は円盤の回転).
+    // RenderQueue::execute と同じく, 頂点シェーダでビューポートを選べればビューの数のインスタンスにして1回で,
+    // できなければビューごとに描く (frameUniforms はこのフレームの execute で書いたものを使う).
+    // 不透明なものを描いた後に, 深度は比べるが書かずに, 古い位置ほど薄く重ねる
+    void draw(const std::vector<View> &views, const glm::mat4 &modelMat) {
+        if (count == 0) {
+            return;
+        }
+        
+        ObjectUniforms values = ObjectUniforms();
+        values.modelMat = modelMat;
+        values.normModelMat = glm::transpose(glm::inverse(modelMat));
+        values.diffColor = color;
+        values.paletteIndex = -1;
+        const GLintptr uniformOffset = objectUniforms.write(&values, sizeof(ObjectUniforms));
+        objectUniforms.bindRange(OBJECT_UNIFORMS_BINDING, uniformOffset, sizeof(ObjectUniforms));
+        
+        glUseProgram(programId);
+        glBindVertexArray(vaoId);
+        glEnable(GL_DEPTH_TEST);
+        glDepthMask(GL_FALSE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        const int numViews = std::min((int)views.size(), MAX_VIEWS);
+        if (numViews > 1 && layeredViews) {
+            setLayeredViewports(views, numViews);
+            frameUniforms.bindPass(0);
+            glDrawArraysInstanced(GL_LINES, first, count, numViews);
+            renderStats.drawCalls++;
+            renderStats.commands += numDrawn;
+        } else {
+            for (int v = 0; v < numViews; v++) {
+                setViewport(views[v]);
+                frameUniforms.bindPass(v);
+                glDrawArrays(GL_LINES, first, count);
+                renderStats.drawCalls++;
+                renderStats.commands += numDrawn;
+            }
+        }
+        glDepthMask(GL_TRUE);
+        glDisable(GL_BLEND);
+        resetViewport();
+        frameUniforms.bindPass(0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+    }
+    
+    void release() {
+        fences.release();
+        buffer.release();
+        glDeleteVertexArrays(1, &vaoId);
+        vaoId = 0u;
+        verticesPerFrame = 0;
+    }
+};
 
 
 RenderObject startDisp;
@@ -389,46 +1959,36 @@ RenderObject background;
 RenderObject cylinder;
 RenderObject bowlingPin1;
 RenderObject bowlingPin2;
-RenderObject bowlingBalls[10];
+InstancedBalls bowlingBalls;
+TrailRenderer trails;
 RenderObject person;
 RenderObject arrow;
 
 Camera camera1;
 Camera camera2;
 
-std::vector<float> ballRun;
-std::vector<float> ballSpeedY;
-std::vector<float> ballPosY;
-std::deque<glm::vec3> ballPos;
-std::deque<glm::vec3> startPos;
-std::deque<glm::vec3> goalPos;
-std::deque<glm::vec4> phi;
-
-float arrowAngle = 0.0f;
-float arrowAngleSpeed = 0.015f;
-float arrowColor = 5.0f;
-float ballAngle;
-float ballSpeed[10] = {0.0005f, 0.001f, 0.0015f, 0.002f, 0.003f, 0.006f, 0.015f, 0.03f, 0.065f, 0.1f};
-float g = 0.0005f;
-
-bool throwing = false;
-bool hit = false;
-
-enum {
-    GAME_MODE_START,
-    GAME_MODE_PLAY,
-    GAME_MODE_CLEAR
-};
+Game game;
+SimClock simClock;
+InputRecorder inputRecorder;
 
 enum {
     FIRST_PERSON,
     BIRD_EYE,
 };
 
-int gameMode = GAME_MODE_START;
 int cameraMode = FIRST_PERSON;
-int modeselect = -1;
-int arrowColorIndex = 5;
+
+// 使えるときは glMultiDrawElementsIndirect でまとめて描く (--no-indirect で1つずつ描く)
+bool useIndirectDraws = true;
+
+// ビューの並べ方 (--view で選び, V キーで切り替える)
+int viewLayout = VIEW_LAYOUT_SINGLE;
+
+// ボールごとに覚えておく軌跡の点の数 (1ステップに1つ. --trail-length. 0 なら軌跡を描かない)
+int trailLength = 64;
+
+// --trail-length の上限 (軌跡の頂点のバッファが大きくなりすぎないように)
+const int MAX_TRAIL_LENGTH = 4096;
 
 
 void initializeGL() {
@@ -437,127 +1997,229 @@ void initializeGL() {
     
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     
+    frameUniforms.initialize();
+    objectUniforms.initialize(OBJECT_UNIFORM_SLOTS, sizeof(ObjectUniforms), true);
+    indirectDraws.initialize(OBJECT_UNIFORM_SLOTS, useIndirectDraws);
+    palette.initialize(PALETTE_TEXFILES);
+    
     startDisp.initialize();
     startDisp.loadOBJ(START_OBJFILE);
     startDisp.buildShader(TEXTURE_SHADER);
     startDisp.loadTexture(START_TEXFILE);
+    startDisp.screenSpace = true;
+    startDisp.layer = LAYER_OVERLAY;
     
     background.initialize();
     background.loadOBJ(BACK_OBJFILE);
     background.buildShader(TEXTURE_SHADER);
     background.loadTexture(BACK_TEXFILE);
+    background.screenSpace = true;
+    background.layer = LAYER_BACKGROUND;
     
     cylinder.initialize();
     cylinder.loadOBJ(CYLINDER_OBJFILE);
-    cylinder.buildShader(RENDER_SHADER);
+    cylinder.buildShader(RENDER_SHADER, RENDER_INDIRECT_SHADER);
     cylinder.loadTexture(CYLINDER_TEXFILE);
     cylinder.modelMat = glm::translate(glm::vec3(0.0f, 0.0f, 0.0f));
     
     bowlingPin1.initialize();
     bowlingPin1.loadOBJ(BOWLINGPIN_OBJFILE);
-    bowlingPin1.buildShader(RENDER_SHADER);
+    bowlingPin1.buildShader(RENDER_SHADER, RENDER_INDIRECT_SHADER);
     bowlingPin1.loadTexture(BOWLINGPIN1_TEXFILE);
     bowlingPin1.modelMat = glm::translate(glm::vec3(0.0f, 0.1f, -0.9f)) * glm::scale(glm::vec3(0.015f, 0.015f, 0.015f));
     
     bowlingPin2.initialize();
     bowlingPin2.loadOBJ(BOWLINGPIN_OBJFILE);
-    bowlingPin2.buildShader(RENDER_SHADER);
+    bowlingPin2.buildShader(RENDER_SHADER, RENDER_INDIRECT_SHADER);
     bowlingPin2.loadTexture(BOWLINGPIN2_TEXFILE);
     bowlingPin2.modelMat = glm::translate(glm::vec3(0.0f, 0.1f, -0.9f)) * glm::scale(glm::vec3(0.015f, 0.015f, 0.015f));
     
-    for (int i=0; i<10; i++){
-        bowlingBalls[i].initialize();
-        bowlingBalls[i].loadOBJ(BOWLINGBALL_OBJFILE);
-        bowlingBalls[i].buildShader(RENDER_SHADER);
-        bowlingBalls[i].loadTexture(BOWLINGBALL_TEXFILES[i]);
-        bowlingBalls[i].modelMat = glm::translate(glm::vec3(0.0f, 0.15f, 0.75f)) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f));
+    bowlingBalls.initialize(BOWLINGBALL_OBJFILE);
+    if (trailLength > 0) {
+        trails.initialize(trailLength);
+    }
+    
+    person.initialize();
+    person.loadOBJ(PERSON_OBJFILE);
+    person.buildShader(RENDER_SHADER, RENDER_INDIRECT_SHADER);
+    person.paletteIndex = PERSON_COLOR_INDEX;
+    person.modelMat = glm::translate(glm::vec3(0.0f, 0.2f, 0.93f)) * glm::scale(glm::vec3(0.002f, 0.002f, 0.002f));
+    
+    arrow.initialize();
+    arrow.loadOBJ(ARROW_OBJFILE);
+    arrow.buildShader(RENDER_SHADER, RENDER_INDIRECT_SHADER);
+    arrow.paletteIndex = game.arrowColorIndex();
+    arrow.modelMat = glm::translate(glm::vec3(0.0f, 0.1f, 0.90f)) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f));
+    
+    // 読み込んだメッシュを区画ごとにまとめて送る
+    meshCache.upload();
+    for (std::map<int, GeometryArena>::iterator it = meshCache.arenas.begin(); it != meshCache.arenas.end(); ++it) {
+        printf("geometry arena (%s, %d-bit indices): %zu vertices, %zu indices\n",
+               it->second.packed ? "packed" : "float", it->second.indexType == GL_UNSIGNED_SHORT ? 16 : 32,
+               it->second.numVertices(), it->second.numIndices());
+    }
+    printf("indirect draws: %s\n", indirectDraws.enabled ? "on" : (indirectDraws.supported ? "off" : "not supported"));
+    
+    // ビューポート配列は GL 4.1 にあるので, 頂点シェーダから選べるかだけを調べる
+    layeredViews = GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_viewport_index;
+    printf("views: %s (%s)\n", VIEW_LAYOUT_NAMES[viewLayout], layeredViews ? "one pass" : "one pass per view");
+    
+    // 投影行列はビューの縦横比に合わせて buildViews で作る
+    camera1.viewMat = glm::lookAt(glm::vec3(0.0f, 1.0f, 1.45f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    
+    camera2.viewMat = glm::lookAt(glm::vec3(1.5f, 1.5f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+}
+
+
+// ボールの色は投げた順に7個ずつ変える
+int ballColor(int i) {
+    return (int)(game.lane().balls().handleAt(i) / 7 % 10);
+}
+
+
+// 転がっているボールのモデル行列 (直前の2ステップの間を補間する)
+glm::mat4 ballModelMat(int i) {
+    const Lane &lane = game.lane();
+    const BallStore &balls = lane.balls();
+    const float alpha = simClock.alpha();
+    glm::vec3 pos;
+    lane.renderBallPosition(i, alpha, &pos[0]);
+    return glm::translate(pos) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(lane.renderTheta(alpha), glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(lane.renderBallSpin(i, alpha), glm::vec3(balls.axisX()[i], 0.0f, balls.axisZ()[i]));
+}
+
+
+// camera で x, y, width, height の長方形に描くビュー
+View makeView(const Camera &camera, int x, int y, int width, int height, float depthNear, float depthFar) {
+    View view;
+    view.camera = camera;
+    view.camera.projMat = glm::perspective(45.0f, (float)width / (float)std::max(height, 1), 0.1f, 1000.0f);
+    view.x = x;
+    view.y = y;
+    view.width = width;
+    view.height = height;
+    view.depthNear = depthNear;
+    view.depthFar = depthFar;
+    return view;
+}
+
+
+// このフレームに描くビューを並べる. 重ねるビューは後ろに置き, 手前の深度の範囲を割り当てる
+std::vector<View> buildViews(int layout) {
+    // スペースキーで選んでいるカメラ (スタート画面では camera1)
+    const bool firstPerson = game.mode() != GAME_MODE_PLAY || game.modeSelect() == -1;
+    const Camera &selected = firstPerson ? camera1 : camera2;
+    const Camera &other = firstPerson ? camera2 : camera1;
+    
+    std::vector<View> views;
+    if (game.mode() != GAME_MODE_PLAY) {
+        layout = VIEW_LAYOUT_SINGLE;
+    }
+    switch (layout) {
+        case VIEW_LAYOUT_SPLIT:
+        {
+            const int half = FB_WIDTH / 2;
+            views.push_back(makeView(camera1, 0, 0, half, FB_HEIGHT, 0.0f, 1.0f));
+            views.push_back(makeView(camera2, half, 0, FB_WIDTH - half, FB_HEIGHT, 0.0f, 1.0f));
+        }
+        break;
+        
+        case VIEW_LAYOUT_PIP:
+        {
+            const int insetWidth = FB_WIDTH / 3;
+            const int insetHeight = FB_HEIGHT / 3;
+            const int margin = std::min(FB_WIDTH, FB_HEIGHT) / 40;
+            views.push_back(makeView(selected, 0, 0, FB_WIDTH, FB_HEIGHT, 0.1f, 1.0f));
+            views.push_back(makeView(other, FB_WIDTH - insetWidth - margin, FB_HEIGHT - insetHeight - margin,
+                                     insetWidth, insetHeight, 0.0f, 0.1f));
+        }
+        break;
+        
+        default:
+            views.push_back(makeView(selected, 0, 0, FB_WIDTH, FB_HEIGHT, 0.0f, 1.0f));
+            break;
     }
+    return views;
+}
+
+
+// このフレームに描くものを, views のどれかの視錐台に入っているかでカリングする (描く前に1回だけ呼ぶ)
+void cullScene(const std::vector<View> &views) {
+    std::vector<Frustum> frustums;
+    for (size_t v = 0; v < views.size(); v++) {
+        frustums.push_back(Frustum(views[v].camera));
+    }
+    RenderObject *const objects[] = { &background, &cylinder, &person, &arrow,
+                                      game.lane().hit() ? &bowlingPin2 : &bowlingPin1 };
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++) {
+        objects[i]->cull(frustums);
+    }
+    bowlingBalls.cull(frustums);
+}
+
+
+// views から見た場面をキューに積んで描く (ソートするので積む順番は関係ない).
+// カリングと描画命令を積むのはビューの数によらず1回だけ
+void drawScene(const std::vector<View> &views) {
+    cullScene(views);
     
-    person.loadOBJ(PERSON_OBJFILE);
-    person.buildShader(RENDER_SHADER);
-    person.loadTexture(PERSON_TEXFILE);
-    person.modelMat = glm::translate(glm::vec3(0.0f, 0.2f, 0.93f)) * glm::scale(glm::vec3(0.002f, 0.002f, 0.002f));
+    background.submit(renderQueue, views);
+    cylinder.submit(renderQueue, views);
+    person.submit(renderQueue, views);
+    arrow.submit(renderQueue, views);
     
-    arrow.initialize();
-    arrow.loadOBJ(ARROW_OBJFILE);
-    arrow.buildShader(RENDER_SHADER);
-    arrow.loadTexture(ARROW_TEXFILES[5]);
-    arrow.modelMat = glm::translate(glm::vec3(0.0f, 0.1f, 0.90f)) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f));
+    // ボールがピンに当たったら赤くする
+    if (game.lane().hit() == false) {
+        bowlingPin1.submit(renderQueue, views);
+    }
+    else {
+        bowlingPin2.submit(renderQueue, views);
+    }
     
-    camera1.projMat = glm::perspective(45.0f, (float)WIN_WIDTH / (float)WIN_HEIGHT, 0.1f, 1000.0f);
-    camera1.viewMat = glm::lookAt(glm::vec3(0.0f, 1.0f, 1.45f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    // 転がっているボールはまとめて描く
+    bowlingBalls.submit(renderQueue, views);
+    renderQueue.execute(views);
     
-    camera2.projMat = glm::perspective(45.0f, (float)WIN_WIDTH / (float)WIN_HEIGHT, 0.1f, 1000.0f);
-    camera2.viewMat = glm::lookAt(glm::vec3(1.5f, 1.5f, 0.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f));
+    // 軌跡は不透明なものの後に重ねる
+    if (trailLength > 0) {
+        trails.upload();
+        trails.draw(views, cylinder.modelMat);
+    }
 }
 
 
 void paintGL() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    objectUniforms.beginFrame();
+    indirectDraws.beginFrame();
+    bowlingBalls.beginFrame();
+    if (trailLength > 0) {
+        trails.beginFrame();
+    }
+    renderStats.reset();
     
-    switch (gameMode) {
+    const std::vector<View> views = buildViews(viewLayout);
+    switch (game.mode()) {
         case GAME_MODE_START:
         {
-            glDisable(GL_DEPTH_TEST);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-            startDisp.draw(camera1);
-            glEnable(GL_DEPTH_TEST);
-            glDisable(GL_BLEND);
+            startDisp.submit(renderQueue, views);
+            renderQueue.execute(views);
         }
         break;
     
         case GAME_MODE_PLAY:
         {
-            if (modeselect == -1){
-                glDisable(GL_DEPTH_TEST);
-                background.draw(camera1);
-                glEnable(GL_DEPTH_TEST);
-                
-                cylinder.draw(camera1);
-                person.draw(camera1);
-                arrow.draw(camera1);
-                
-                // ボールがピンに当たったら赤くする
-                if(hit==false){
-                    bowlingPin1.draw(camera1);
-                }
-                else{
-                    bowlingPin2.draw(camera1);
-                }
-                
-                // ボールの色を変化させる
-                for(int i=0; i<startPos.size(); i++){
-                    int ballColorIndex = i / 7 ;
-                    bowlingBalls[ballColorIndex].modelMat = glm::translate(ballPos[i]) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(theta, glm::vec3(0.0f, 1.0f, 0.0f))* glm::rotate(phi[i][0], glm::vec3(phi[i][1], phi[i][2], phi[i][3]));
-                    bowlingBalls[ballColorIndex].draw(camera1);
-                }
-            }
-            else{
-                glDisable(GL_DEPTH_TEST);
-                background.draw(camera2);
-                glEnable(GL_DEPTH_TEST);
-
-                cylinder.draw(camera2);
-                person.draw(camera2);
-                arrow.draw(camera2);
-                
-                // ボールがピンに当たったら赤くする
-                if(hit==false){
-                    bowlingPin1.draw(camera2);
-                }
-                else{
-                    bowlingPin2.draw(camera2);
-                }
-
-                // ボールの色を変化させる
-                for(int i=0; i<startPos.size(); i++){
-                    int ballColorIndex = i / 7;
-                    bowlingBalls[ballColorIndex].modelMat = glm::translate(ballPos[i]) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(theta, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::rotate(phi[i][0], glm::vec3(phi[i][1], phi[i][2], phi[i][3]));
-                    bowlingBalls[ballColorIndex].draw(camera2);
-                }
-            }
+            drawScene(views);
         }
+        break;
+
+        default:
+            break;
+    }
+    objectUniforms.endFrame();
+    indirectDraws.endFrame();
+    bowlingBalls.endFrame();
+    if (trailLength > 0) {
+        trails.endFrame();
     }
 }
 
@@ -571,18 +2233,43 @@ void resizeGL(GLFWwindow *window, int width, int height) {
     glfwSetWindowSize(window, WIN_WIDTH, WIN_HEIGHT);
     
     // 実際のウィンドウサイズ (ピクセル数) を取得
-    int renderBufferWidth, renderBufferHeight;
-    glfwGetFramebufferSize(window, &renderBufferWidth, &renderBufferHeight);
+    glfwGetFramebufferSize(window, &FB_WIDTH, &FB_HEIGHT);
     
-    // ビューポート変換の更新
-    glViewport(0, 0, renderBufferWidth, renderBufferHeight);
+    // ビューポート変換の更新 (ビューごとのビューポートは描くときに buildViews の値で設定する)
+    glViewport(0, 0, FB_WIDTH, FB_HEIGHT);
 }
 
 
+void keyboard(GLFWwindow *window);
+void updateScene();
+
+// シミュレーションを1ステップ進めるたびに呼ぶ (軌跡の点はフレームではなくステップごとに足す)
+void recordStep() {
+    if (trailLength > 0 && game.mode() == GAME_MODE_PLAY) {
+        trails.record(game.lane());
+    }
+}
+
 // アニメーションのためのアップデート
-void animate() {
-    if (gameMode == GAME_MODE_PLAY) {
-        theta += 2.0f * PI / 360.0f;  // 10分の1回転
+void animate(GLFWwindow *window, double frameTime) {
+    const int steps = simClock.advance(frameTime);
+    if (game.mode() == GAME_MODE_PLAY) {
+        // シミュレーションは描画とは関係なく固定の時間刻みで進める
+        for (int s = 0; s < steps; s++) {
+            keyboard(window);
+            recordStep();
+        }
+    }
+    updateScene();
+}
+
+
+// 進めたシミュレーションに合わせて, カメラと描くものを動かす
+void updateScene() {
+    const Lane &lane = game.lane();
+    const float arrowAngle = game.arrowAngle();
+    if (game.mode() == GAME_MODE_PLAY) {
+        const float theta = lane.renderTheta(simClock.alpha());
         camera1.viewMat = glm::lookAt(glm::vec3(1.45*sin(theta), 1.0f, 1.45*cos(theta)), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
         
         bowlingPin1.modelMat = glm::translate(glm::vec3(-0.9*sin(theta), 0.1f, -0.9*cos(theta))) * glm::scale(glm::vec3(0.015, 0.015, 0.015));
@@ -593,136 +2280,806 @@ void animate() {
         person.modelMat =  glm::translate(glm::vec3(0.93*sin(theta+0.07) , 0.2f, 0.93*cos(theta+0.07))) * glm::scale(glm::vec3(0.003f, 0.003f, 0.003f)) * glm::rotate(theta+PI, glm::vec3(0.0f, 1.0f, 0.0f));
         
         arrow.modelMat =  glm::translate(glm::vec3(0.75f*sin(theta), 0.1f, 0.75f*cos(theta))) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(theta + PI/2 + arrowAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+        // 速さを変えたときは色見本の層を変えるだけ
+        arrow.paletteIndex = game.arrowColorIndex();
     
-        if(throwing){
-            for(int i=0; i<startPos.size(); i++){
-                ballRun[i] += ballSpeed[arrowColorIndex];
-                phi[i][0] -= 2.0f * PI / 90.0f;
-                
-                ballPos[i] = ballRun[i] * goalPos[i] + (1-ballRun[i]) * startPos[i];
-                
-                if(ballPos[i][0]*ballPos[i][0] + ballPos[i][2]*ballPos[i][2] >= 1.0f){
-                    ballSpeedY[i] += g;
-                    ballPosY[i] -= ballSpeedY[i];
-                    ballPos[i][1] = ballPosY[i];
+        // ボールの色は投げた順に変える
+        bowlingBalls.instances.resize(lane.numBalls());
+        for (int i = 0; i < lane.numBalls(); i++) {
+            bowlingBalls.instances[i].modelMat = ballModelMat(i);
+            bowlingBalls.instances[i].colorIndex = (float)ballColor(i);
+        }
+        if (trailLength > 0) {
+            trails.setHeads(lane, simClock.alpha());
+        }
+    }
+}
+
+
+// 押されているキーを見て, シミュレーションを1ステップ進める
+void keyboard(GLFWwindow *window) {
+    unsigned int heldKeys = 0;
+    int state;
+    
+    // left
+    state = glfwGetKey(window, GLFW_KEY_LEFT);
+    if (state == GLFW_PRESS || state == GLFW_REPEAT) {
+        heldKeys |= HELD_LEFT;
+    }
+    
+    // right
+    state = glfwGetKey(window, GLFW_KEY_RIGHT);
+    if (state == GLFW_PRESS || state == GLFW_REPEAT) {
+        heldKeys |= HELD_RIGHT;
+    }
+    
+    // up
+    if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
+        heldKeys |= HELD_UP;
+    }
+    
+    // down
+    if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
+        heldKeys |= HELD_DOWN;
+    }
+    
+    game.step(heldKeys);
+}
+
+
+void keyboardCallback(GLFWwindow *window, int key, int scanmode, int action, int mods) {
+    if (action != GLFW_PRESS) {
+        return;
+    }
+    
+    // Space --- viewmode change, Enter --- start / throwing, Escape --- back to start, V --- view layout
+    switch (key) {
+        case GLFW_KEY_SPACE:
+            game.press(PRESSED_SPACE);
+            break;
+        case GLFW_KEY_ENTER:
+            game.press(PRESSED_ENTER);
+            break;
+        case GLFW_KEY_ESCAPE:
+            game.press(PRESSED_ESCAPE);
+            break;
+        case GLFW_KEY_V:
+            // 見せ方だけなので, シミュレーションには渡さない (入力の記録にも残らない)
+            viewLayout = (viewLayout + 1) % NUM_VIEW_LAYOUTS;
+            printf("view layout: %s\n", VIEW_LAYOUT_NAMES[viewLayout]);
+            break;
+    }
+}
+
+
+// uniform ブロックを使う前の RenderObject::draw と同じ描き方 (--bench-draw の lookup で比べるため).
+// 描くたびに uniform の場所を調べて glUniform* で1つずつ送り, キューを通さずにすぐ描く
+void drawLegacy(const RenderObject &object, const Camera &camera, GLuint programId) {
+    glUseProgram(programId);
+    
+    GLint location;
+    location = glGetUniformLocation(programId, "u_ambiColor");
+    glUniform3fv(location, 1, glm::value_ptr(object.ambiColor));
+    location = glGetUniformLocation(programId, "u_diffColor");
+    glUniform3fv(location, 1, glm::value_ptr(object.diffColor));
+    location = glGetUniformLocation(programId, "u_specColor");
+    glUniform3fv(location, 1, glm::value_ptr(object.specColor));
+    location = glGetUniformLocation(programId, "u_shininess");
+    glUniform1f(location, object.shininess);
+    
+    glm::mat4 mvMat, mvpMat, normMat;
+    mvMat = camera.viewMat * object.modelMat;
+    mvpMat = camera.projMat * mvMat;
+    normMat = glm::transpose(glm::inverse(mvMat));
+    
+    location = glGetUniformLocation(programId, "u_lightPos");
+    glUniform3fv(location, 1, glm::value_ptr(lightPos));
+    location = glGetUniformLocation(programId, "u_lightMat");
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(camera.viewMat));
+    location = glGetUniformLocation(programId, "u_mvMat");
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mvMat));
+    location = glGetUniformLocation(programId, "u_mvpMat");
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mvpMat));
+    location = glGetUniformLocation(programId, "u_normMat");
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(normMat));
+    
+    // 以前はなかった, 詰めた頂点を戻す係数
+    const VertexQuantization &q = object.quantization;
+    location = glGetUniformLocation(programId, "u_positionOffset");
+    glUniform3fv(location, 1, q.positionOffset);
+    location = glGetUniformLocation(programId, "u_positionScale");
+    glUniform3fv(location, 1, q.positionScale);
+    location = glGetUniformLocation(programId, "u_texcoordTransform");
+    glUniform4f(location, q.texcoordOffset[0], q.texcoordOffset[1], q.texcoordScale[0], q.texcoordScale[1]);
+    
+    if (object.textureId != 0) {
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, object.textureId);
+        location = glGetUniformLocation(programId, "u_isTextured");
+        glUniform1i(location, 1);
+        location = glGetUniformLocation(programId, "u_texture");
+        glUniform1i(location, TEXTURE_UNIT);
+    } else {
+        location = glGetUniformLocation(programId, "u_isTextured");
+        glUniform1i(location, 0);
+    }
+    
+    const MeshLod &lod = object.lods[0];
+    glBindVertexArray(object.vaoId);
+    glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, object.indexType,
+                             (void*)(lod.firstIndex * indexSize(object.indexType)), object.baseVertex);
+    glBindVertexArray(0);
+    
+    glUseProgram(0);
+}
+
+
+// 1フレームに numObjects 個のピンを描き, 描画命令を出すのに CPU がかかる時間をオブジェクトあたりで測る.
+//   lookup     以前の RenderObject::draw と同じく, 描くたびに uniform の場所を調べて glUniform* で送る (drawLegacy)
+//   subdata    オブジェクトごとの値だけを glBufferSubData でリングに書く
+//   persistent オブジェクトごとの値を永続的にマップしたリングに memcpy する
+//   indirect   オブジェクトごとの値を SSBO に書き, 1回の glMultiDrawElementsIndirect でまとめて描く
+void benchDraw(int numObjects) {
+    static const int NUM_BENCH_FRAMES = 200;
+    static const char *MODE_NAMES[] = { "lookup", "subdata", "persistent", "indirect" };
+    const GLuint legacyProgramId = programCache.get(LEGACY_SHADER);
+    
+    for (int mode = 0; mode < 4; mode++) {
+        objectUniforms.release();
+        objectUniforms.initialize(numObjects, sizeof(ObjectUniforms), mode == 2);
+        indirectDraws.release();
+        indirectDraws.initialize(numObjects, mode == 3);
+        if (mode == 2 && !objectUniforms.buffer.persistent) {
+            printf("%-10s GL_ARB_buffer_storage is not available\n", MODE_NAMES[mode]);
+            continue;
+        }
+        if (mode == 3 && !indirectDraws.enabled) {
+            printf("%-10s multi-draw indirect is not available\n", MODE_NAMES[mode]);
+            continue;
+        }
+        
+        const std::vector<View> views = buildViews(VIEW_LAYOUT_SINGLE);
+        double seconds = 0.0;
+        for (int f = 0; f < NUM_BENCH_FRAMES; f++) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            objectUniforms.beginFrame();
+            indirectDraws.beginFrame();
+            
+            const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+            if (mode == 0) {
+                for (int i = 0; i < numObjects; i++) {
+                    drawLegacy(bowlingPin1, views[0].camera, legacyProgramId);
                 }
-            }
-            if(ballPos[0][1] <= -5.0f){
-                ballRun.erase(ballRun.begin());
-                ballSpeedY.erase(ballSpeedY.begin());
-                ballPosY.erase(ballPosY.begin());
-                ballPos.erase(ballPos.begin());
-                startPos.erase(startPos.begin());
-                goalPos.erase(goalPos.begin());
-                phi.erase(phi.begin());
-            }
-  
-            // 当たり判定
-            hit = false;
-            for(int i=0; i<startPos.size(); i++){
-                glm::vec3 diff = ballPos[i] - glm::vec3(-0.9*sin(theta), 0.1f, -0.9*cos(theta));
-                if (glm::length(diff) <= 0.08f){
-                    hit = true;
-                    continue;
+            } else {
+                for (int i = 0; i < numObjects; i++) {
+                    bowlingPin1.submit(renderQueue, views);
                 }
+                renderQueue.execute(views);
             }
+            const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+            seconds += std::chrono::duration<double>(end - start).count();
             
+            // GPU の時間は含めない
+            objectUniforms.endFrame();
+            indirectDraws.endFrame();
+            glFinish();
         }
-        else {
-            bowlingBalls[0].modelMat = glm::translate(glm::vec3(0.75*sin(theta) , 0.1f, 0.75*cos(theta))) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(theta, glm::vec3(0.0f, 1.0f, 0.0f));
-        }
+        printf("%-10s %d objects: %.3f us/object\n", MODE_NAMES[mode], numObjects,
+               seconds * 1.0e6 / ((double)NUM_BENCH_FRAMES * numObjects));
     }
+    
+    // ゲームで使う大きさと設定に戻す
+    objectUniforms.release();
+    objectUniforms.initialize(OBJECT_UNIFORM_SLOTS, sizeof(ObjectUniforms), true);
+    indirectDraws.release();
+    indirectDraws.initialize(OBJECT_UNIFORM_SLOTS, useIndirectDraws);
 }
 
 
-void initArrow(int iarrowColorIndex){
-    arrow.initialize();
-    arrow.loadOBJ(ARROW_OBJFILE);
-    arrow.buildShader(RENDER_SHADER);
-    arrow.loadTexture(ARROW_TEXFILES[iarrowColorIndex]);
-    arrow.modelMat =  glm::translate(glm::vec3(0.75f*sin(theta), 0.1f, 0.75f*cos(theta))) * glm::scale(glm::vec3(0.04f, 0.04f, 0.04f)) * glm::rotate(theta + PI/2 + arrowAngle, glm::vec3(0.0f, 1.0f, 0.0f));
+// 記録した入力を描画せずに全速力で再生し, チェックサムを確かめる
+int replay(const std::string &filename, bool printChecksums) {
+    InputLog log;
+    if (!log.load(filename)) {
+        fprintf(stderr, "Failed to load input log: %s\n", filename.c_str());
+        return 1;
+    }
     
+    Game replayGame(log.config());
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    const ReplayResult result = replayInputLog(log, replayGame, printChecksums ? stdout : NULL);
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    
+    printf("replayed %llu ticks (%d events) in %.3f s, %.4g ticks/s\n", result.ticks, result.events, seconds, result.ticks / seconds);
+    if (result.desync) {
+        fprintf(stderr, "Input log is out of sync at tick %llu!\n", replayGame.tick());
+        return 1;
+    }
+    if (result.firstMismatch >= 0) {
+        fprintf(stderr, "Checksum mismatch at tick %lld!\n", result.firstMismatch);
+        return 1;
+    }
+    printf("%d checksums match\n", result.checksums);
+    return 0;
 }
 
 
-void keyboard(GLFWwindow *window) {
-    int state;
+// ウィンドウを開かずに描くための GL のコンテキスト (EGL).
+// Mesa の surfaceless プラットフォームがあればディスプレイなしで動く (llvmpipe なら GPU もいらない).
+// 描画先は OffscreenTarget の FBO なので, サーフェスは作れなければ 1x1 の pbuffer で済ませる.
+struct OffscreenContext {
+#ifdef CORIOLIS_HAVE_EGL
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+#endif
     
-    if (gameMode == GAME_MODE_PLAY) {
-        // left
-        state = glfwGetKey(window, GLFW_KEY_LEFT);
-        if (state == GLFW_PRESS || state == GLFW_REPEAT) {
-            arrowAngle += arrowAngleSpeed;
-            arrowAngle = std::min(arrowAngle, +1.5f);
+    bool create(std::string *err) {
+#ifdef CORIOLIS_HAVE_EGL
+        display = EGL_NO_DISPLAY;
+        surface = EGL_NO_SURFACE;
+        context = EGL_NO_CONTEXT;
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        }
+#endif
+        if (display == EGL_NO_DISPLAY) {
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        }
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+            *err = "no EGL display";
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            *err = "EGL cannot create desktop OpenGL contexts";
+            return false;
         }
         
-        // right
-        state = glfwGetKey(window, GLFW_KEY_RIGHT);
-        if (state == GLFW_PRESS || state == GLFW_REPEAT) {
-            arrowAngle -= arrowAngleSpeed;
-            arrowAngle = std::max(arrowAngle, -1.5f);
+        // コンフィグがなくても (EGL_KHR_no_config_context) コンテキストは作れる
+        const EGLint configAttribs[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = (EGLConfig)0;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0) {
+            config = (EGLConfig)0;
         }
         
-        // up
-        state = glfwGetKey(window, GLFW_KEY_UP);
-        if (state == GLFW_PRESS) {
-            arrowColor += 0.2f;
-            arrowColorIndex = int(arrowColor);
-            arrowColorIndex = std::min(arrowColorIndex, 9);
-            arrowColorIndex = std::max(arrowColorIndex, 0);
-            initArrow(arrowColorIndex);
+        const EGLint contextAttribs[] = { EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+                                          EGL_CONTEXT_MINOR_VERSION_KHR, 1,
+                                          EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                                          EGL_NONE };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (context == EGL_NO_CONTEXT) {
+            *err = "failed to create an OpenGL 4.1 core context";
+            return false;
+        }
+        if (eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            return true;
+        }
+        if (numConfigs > 0) {
+            const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+            surface = eglCreatePbufferSurface(display, config, pbufferAttribs);
+            if (surface != EGL_NO_SURFACE && eglMakeCurrent(display, surface, surface, context)) {
+                return true;
+            }
+        }
+        *err = "failed to make the context current";
+        return false;
+#else
+        *err = "built without EGL";
+        return false;
+#endif
+    }
+    
+    void release() {
+#ifdef CORIOLIS_HAVE_EGL
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (surface != EGL_NO_SURFACE) {
+            eglDestroySurface(display, surface);
         }
+        eglDestroyContext(display, context);
+        eglTerminate(display);
+#endif
+    }
+};
+
+
+// 画面の代わりに描く FBO (色と深度のレンダーバッファ) と, 色を読み出すための PBO.
+// 読み出しは PBO に頼んでおいて次のフレームで取り出すので, GPU が描き終わるのを待たずに次のフレームを描ける.
+struct OffscreenTarget {
+    static const int NUM_READBACKS = 2;
+    
+    GLuint fboId;
+    GLuint colorId;
+    GLuint depthId;
+    GLuint pboIds[NUM_READBACKS];
+    int width;
+    int height;
+    
+    bool initialize(int w, int h) {
+        width = w;
+        height = h;
+        glGenRenderbuffers(1, &colorId);
+        glBindRenderbuffer(GL_RENDERBUFFER, colorId);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &depthId);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthId);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
         
-        // down
-        state = glfwGetKey(window, GLFW_KEY_DOWN);
-        if (state == GLFW_PRESS) {
-            arrowColor -= 0.2f;
-            arrowColorIndex = int(arrowColor);
-            arrowColorIndex = std::min(arrowColorIndex, 9);
-            arrowColorIndex = std::max(arrowColorIndex, 0);
-            initArrow(arrowColorIndex);
+        glGenFramebuffers(1, &fboId);
+        glBindFramebuffer(GL_FRAMEBUFFER, fboId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorId);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthId);
+        const bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glViewport(0, 0, width, height);
+        
+        glGenBuffers(NUM_READBACKS, pboIds);
+        for (int i = 0; i < NUM_READBACKS; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return complete;
+    }
+    
+    // frame 番目のフレームの色を PBO に読み出し始める
+    void requestReadback(int frame) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[frame % NUM_READBACKS]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    
+    // 読み出した色を上の行から順に rgba に取り出す (GL は下の行から並んでいる)
+    bool mapReadback(int frame, std::vector<unsigned char> *rgba) {
+        const size_t rowSize = (size_t)width * 4;
+        rgba->resize(rowSize * height);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pboIds[frame % NUM_READBACKS]);
+        const unsigned char *pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowSize * height, GL_MAP_READ_BIT);
+        if (pixels) {
+            for (int y = 0; y < height; y++) {
+                memcpy(&(*rgba)[rowSize * y], pixels + rowSize * (height - 1 - y), rowSize);
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
         }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return pixels != NULL;
+    }
+    
+    void release() {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fboId);
+        glDeleteRenderbuffers(1, &colorId);
+        glDeleteRenderbuffers(1, &depthId);
+        glDeleteBuffers(NUM_READBACKS, pboIds);
+    }
+};
+
+
+// GPU がフレームを描くのにかかった時間を GL_TIME_ELAPSED のクエリで測る.
+// 結果は NUM_QUERIES - 1 フレーム後に取り出すので, 取り出すときに GPU を待つことはほとんどない.
+struct GpuTimer {
+    static const int NUM_QUERIES = 4;
+    
+    GLuint queryIds[NUM_QUERIES];
+    
+    void initialize() {
+        glGenQueries(NUM_QUERIES, queryIds);
+    }
+    
+    void begin(int frame) {
+        glBeginQuery(GL_TIME_ELAPSED, queryIds[frame % NUM_QUERIES]);
+    }
+    
+    void end() {
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+    
+    double milliseconds(int frame) {
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queryIds[frame % NUM_QUERIES], GL_QUERY_RESULT, &nanoseconds);
+        return nanoseconds * 1.0e-6;
+    }
+    
+    void release() {
+        glDeleteQueries(NUM_QUERIES, queryIds);
+    }
+};
+
+
+struct FrameTiming {
+    double simMs;       // シミュレーションを進めて描くものを動かした CPU の時間
+    double cpuMs;       // paintGL で描画命令を出した CPU の時間
+    double gpuMs;       // GPU が描いた時間
+};
+
+// --headless の設定
+struct HeadlessOptions {
+    int width;
+    int height;
+    int frames;                 // 0 なら入力ログの終わりまで (ログがなければ 300)
+    double fps;                 // 1フレームで進める時間は 1 / fps 秒
+    std::string replayFile;     // 空でなければ, 記録した入力で遊ぶ
+    std::string dumpPrefix;     // 空でなければフレームを書き出す
+    bool dumpRaw;               // true なら <dumpPrefix>.rgba に RGBA をつなげて書く, false なら <dumpPrefix>00000.png, ...
+    std::string timingFile;     // 空でなければフレームごとの時間を CSV で書く
+    
+    HeadlessOptions()
+    : width(1280)
+    , height(720)
+    , frames(0)
+    , fps(60.0)
+    , dumpRaw(false) {
+    }
+};
+
+// frame 番目のフレームを読み出して, PNG か RGBA で書き出す
+void writeFrame(OffscreenTarget &target, int frame, const HeadlessOptions &options, FILE *rawFile,
+                std::vector<unsigned char> *pixels) {
+    if (!target.mapReadback(frame, pixels)) {
+        fprintf(stderr, "Failed to read frame %d!\n", frame);
+        return;
+    }
+    if (rawFile) {
+        fwrite(pixels->data(), 1, pixels->size(), rawFile);
+        return;
+    }
+    char suffix[32];
+    sprintf(suffix, "%05d.png", frame);
+    if (!writePng(options.dumpPrefix + suffix, target.width, target.height, pixels->data())) {
+        fprintf(stderr, "Failed to write %s%s\n", options.dumpPrefix.c_str(), suffix);
     }
 }
 
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+}
 
-void keyboardCallback(GLFWwindow *window, int key, int scanmode, int action, int mods) {
-    if (gameMode == GAME_MODE_PLAY) {
-        // Space --- viewmode change
-        if (key == GLFW_KEY_SPACE && action == GLFW_PRESS) {
-            modeselect *= -1;
+// ウィンドウを開かずに FBO に描き, フレームを書き出して, フレームごとの CPU と GPU の時間をまとめる.
+// キー入力の代わりに記録した入力ログで遊ぶ (ログがなければ, 始めてから何もしない).
+int runHeadless(const HeadlessOptions &options, const LaneConfig &laneConfig) {
+    InputLog log;
+    if (!options.replayFile.empty() && !log.load(options.replayFile)) {
+        fprintf(stderr, "Failed to load input log: %s\n", options.replayFile.c_str());
+        return 1;
+    }
+    
+    OffscreenContext context;
+    std::string err;
+    if (!context.create(&err)) {
+        fprintf(stderr, "Headless context creation failed: %s\n", err.c_str());
+        return 1;
+    }
+    
+    // EGL のコンテキストでは GLX のディスプレイがないと言われるが, GL の関数は読み込めている
+    glewExperimental = true;
+    const GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (glewStatus != GLEW_OK && glewStatus != GLEW_ERROR_NO_GLX_DISPLAY) {
+#else
+    if (glewStatus != GLEW_OK) {
+#endif
+        fprintf(stderr, "GLEW initialization failed!\n");
+        return 1;
+    }
+    printf("renderer: %s (%s)\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+    
+    const bool replaying = !options.replayFile.empty();
+    game = Game(replaying ? log.config() : laneConfig);
+    simClock.setDt(replaying ? log.config().dt : laneConfig.dt);
+    if (!replaying) {
+        game.press(PRESSED_ENTER);
+    }
+    InputPlayer player(log);
+    
+    WIN_WIDTH = options.width;
+    WIN_HEIGHT = options.height;
+    FB_WIDTH = options.width;
+    FB_HEIGHT = options.height;
+    initializeGL();
+    
+    OffscreenTarget target;
+    if (!target.initialize(options.width, options.height)) {
+        fprintf(stderr, "Offscreen framebuffer is incomplete!\n");
+        return 1;
+    }
+    GpuTimer gpuTimer;
+    gpuTimer.initialize();
+    
+    FILE *rawFile = NULL;
+    if (!options.dumpPrefix.empty() && options.dumpRaw) {
+        rawFile = fopen((options.dumpPrefix + ".rgba").c_str(), "wb");
+        if (!rawFile) {
+            fprintf(stderr, "Failed to open %s.rgba\n", options.dumpPrefix.c_str());
+            return 1;
+        }
+    }
+    std::vector<unsigned char> pixels;
+    std::vector<FrameTiming> timings;
+    const int maxFrames = options.frames > 0 ? options.frames : (replaying ? INT_MAX : 300);
+    
+    bool finished = false;
+    for (int frame = 0; frame < maxFrames && !finished; frame++) {
+        // シミュレーションはウィンドウのときと同じく固定の時間刻みで進める
+        const std::chrono::high_resolution_clock::time_point simStart = std::chrono::high_resolution_clock::now();
+        const int steps = simClock.advance(1.0 / options.fps);
+        for (int s = 0; s < steps && !finished; s++) {
+            if (replaying) {
+                finished = !player.step(game);
+            } else {
+                game.step(0);
+            }
+            if (!finished) {
+                recordStep();
+            }
         }
+        updateScene();
+        
+        const std::chrono::high_resolution_clock::time_point cpuStart = std::chrono::high_resolution_clock::now();
+        gpuTimer.begin(frame);
+        paintGL();
+        gpuTimer.end();
+        const std::chrono::high_resolution_clock::time_point cpuEnd = std::chrono::high_resolution_clock::now();
         
-        // Enter --- throwing
-        if (key == GLFW_KEY_ENTER && action == GLFW_PRESS) {
-            throwing = true;
-            ballAngle = arrowAngle;
-            if (startPos.size() < 70){
-                startPos.push_back(glm::vec3(0.75f*sin(theta), 0.15f, 0.75f*cos(theta)));
-                goalPos.push_back(glm::vec3(0.75f*sin(theta-(PI-2*ballAngle)), 0.15f, 0.75f*cos(theta-(PI-2*ballAngle))));
-                ballRun.push_back(0.0f);
-                ballSpeedY.push_back(0.0f);
-                ballPosY.push_back(0.15f);
-                ballPos.push_back(glm::vec3(0.75f*sin(theta), 0.15f, 0.75f*cos(theta)));
-                phi.push_back(glm::vec4(0.0f, sin(theta)/2, 0.0f, cos(theta)/2));
+        FrameTiming timing;
+        timing.simMs = std::chrono::duration<double, std::milli>(cpuStart - simStart).count();
+        timing.cpuMs = std::chrono::duration<double, std::milli>(cpuEnd - cpuStart).count();
+        timing.gpuMs = 0.0;
+        timings.push_back(timing);
+        
+        // 1つ前のフレームを取り出して書く
+        if (!options.dumpPrefix.empty()) {
+            target.requestReadback(frame);
+            if (frame > 0) {
+                writeFrame(target, frame - 1, options, rawFile, &pixels);
             }
         }
-        if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-            gameMode = GAME_MODE_START;
+        if (frame >= GpuTimer::NUM_QUERIES - 1) {
+            const int done = frame - (GpuTimer::NUM_QUERIES - 1);
+            timings[done].gpuMs = gpuTimer.milliseconds(done);
         }
     }
-    else {
-        if (key == GLFW_KEY_ENTER && action == GLFW_PRESS) {
-            if (gameMode == GAME_MODE_START) {
-                gameMode = GAME_MODE_PLAY;
-                arrowAngle = 0.0f;
+    
+    // 残りのフレームと時間を取り出す
+    const int numFrames = (int)timings.size();
+    if (!options.dumpPrefix.empty() && numFrames > 0) {
+        writeFrame(target, numFrames - 1, options, rawFile, &pixels);
+    }
+    for (int f = std::max(0, numFrames - (GpuTimer::NUM_QUERIES - 1)); f < numFrames; f++) {
+        timings[f].gpuMs = gpuTimer.milliseconds(f);
+    }
+    if (rawFile) {
+        fclose(rawFile);
+    }
+    if (player.desync()) {
+        fprintf(stderr, "Input log is out of sync at tick %llu!\n", game.tick());
+    }
+    
+    std::vector<double> simMs, cpuMs, gpuMs;
+    for (int f = 0; f < numFrames; f++) {
+        simMs.push_back(timings[f].simMs);
+        cpuMs.push_back(timings[f].cpuMs);
+        gpuMs.push_back(timings[f].gpuMs);
+    }
+    if (!options.timingFile.empty()) {
+        FILE *fp = fopen(options.timingFile.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "frame,sim_ms,cpu_ms,gpu_ms\n");
+            for (int f = 0; f < numFrames; f++) {
+                fprintf(fp, "%d,%.4f,%.4f,%.4f\n", f, simMs[f], cpuMs[f], gpuMs[f]);
             }
+            fclose(fp);
+        } else {
+            fprintf(stderr, "Failed to open %s\n", options.timingFile.c_str());
+        }
+    }
+    // 最初のフレームはバッファの確保などが入るので (GPU の時間も正しく測れないことがある), まとめには入れない
+    printf("%d frames at %dx%d, tick %llu, %d balls\n", numFrames, options.width, options.height, game.tick(), game.lane().numBalls());
+    const char *NAMES[] = { "sim", "cpu", "gpu" };
+    std::vector<double> *values[] = { &simMs, &cpuMs, &gpuMs };
+    for (int k = 0; k < 3; k++) {
+        if (values[k]->size() > 1) {
+            values[k]->erase(values[k]->begin());
         }
+        double total = 0.0;
+        for (size_t f = 0; f < values[k]->size(); f++) {
+            total += (*values[k])[f];
+        }
+        printf("%s: %.3f ms mean, %.3f ms median, %.3f ms p95, %.3f ms max\n", NAMES[k],
+               values[k]->empty() ? 0.0 : total / values[k]->size(), percentile(*values[k], 0.5),
+               percentile(*values[k], 0.95), percentile(*values[k], 1.0));
+    }
+    
+    gpuTimer.release();
+    target.release();
+    if (trailLength > 0) {
+        trails.release();
+    }
+    bowlingBalls.release();
+    palette.release();
+    indirectDraws.release();
+    objectUniforms.release();
+    frameUniforms.release();
+    programCache.release();
+    meshCache.release();
+    context.release();
+    return player.desync() ? 1 : 0;
+}
+
+
+// 数値の引数を読む. 数として読めない (後ろに余分な文字がある) か, 有限でなければ false
+bool parseNumber(const char *text, float *value) {
+    char *end = NULL;
+    const double number = strtod(text, &end);
+    if (end == text || *end != '\0' || !std::isfinite(number)) {
+        return false;
+    }
+    *value = (float)number;
+    return true;
+}
+
+// 整数の引数を読む. 整数として読めないか, [minValue, maxValue] に入らなければ false
+bool parseCount(const char *text, int minValue, int maxValue, int *value) {
+    char *end = NULL;
+    const long number = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || number < minValue || number > maxValue) {
+        return false;
+    }
+    *value = (int)number;
+    return true;
+}
+
+// 幅と高さ (1280x720 など) を読む. どちらも 1 以上 maxSize 以下でなければ false
+bool parseSize(const char *text, int maxSize, int *width, int *height) {
+    const char *x = strchr(text, 'x');
+    if (x == NULL) {
+        return false;
     }
+    const std::string w(text, x);
+    return parseCount(w.c_str(), 1, maxSize, width) && parseCount(x + 1, 1, maxSize, height);
 }
 
+int usage(const char *program, const std::string &message) {
+    fprintf(stderr, "%s\n", message.c_str());
+    fprintf(stderr, "usage: %s [--hz <hz>] [--omega <rad/s>] [--dynamics chord|euler|rk4] [--view single|split|pip]\n"
+                    "       [--record <file>] [--replay <file> [--checksums]] [--bench-draw <n>] [--stats] [--no-indirect]\n"
+                    "       [--trail-length <0-4096>] [--headless [--size WxH] [--frames <n>] [--fps <fps>] [--dump <prefix>]\n"
+                    "       [--dump-format png|rgba] [--timing <file>]]\n", program);
+    return 1;
+}
 
 int main(int argc, char **argv) {
+    // シミュレーションの周波数 (--hz 1000 など), 円盤の角速度 (--omega), 運動の計算方法 (--dynamics rk4 など)
+    // 入力の記録 (--record input.cril) と再生 (--replay input.cril [--checksums])
+    // 描画命令の CPU の時間の計測 (--bench-draw 1000), 描いたオブジェクトの数の表示 (--stats)
+    // 間接描画を使わずに1つずつ描く (--no-indirect)
+    // ビューの並べ方 (--view single|split|pip. ウィンドウでは V キーで切り替える)
+    // ボールの軌跡の点の数 (--trail-length 64. 1ステップに1つ. 0 なら描かない. 4096 まで)
+    // ウィンドウを開かずに描く (--headless [--size 1280x720] [--frames 600] [--fps 60] [--replay input.cril]
+    //                             [--dump frames/f] [--dump-format png|rgba] [--timing timing.csv])
+    LaneConfig laneConfig;
+    std::string recordFile;
+    std::string replayFile;
+    bool printChecksums = false;
+    int benchObjects = 0;
+    bool printStats = false;
+    bool headless = false;
+    HeadlessOptions headlessOptions;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--record" && i + 1 < argc) {
+            recordFile = argv[++i];
+        }
+        if (arg == "--replay" && i + 1 < argc) {
+            replayFile = argv[++i];
+        }
+        if (arg == "--checksums") {
+            printChecksums = true;
+        }
+        if (arg == "--bench-draw" && i + 1 < argc) {
+            benchObjects = atoi(argv[++i]);
+        }
+        if (arg == "--stats") {
+            printStats = true;
+        }
+        if (arg == "--no-indirect") {
+            useIndirectDraws = false;
+        }
+        if (arg == "--view" && i + 1 < argc) {
+            const std::string name = argv[++i];
+            int layout = -1;
+            for (int l = 0; l < NUM_VIEW_LAYOUTS; l++) {
+                if (name == VIEW_LAYOUT_NAMES[l]) {
+                    layout = l;
+                }
+            }
+            if (layout < 0) {
+                return usage(argv[0], "Unknown view layout: " + name);
+            }
+            viewLayout = layout;
+        }
+        if (arg == "--trail-length" && i + 1 < argc) {
+            if (!parseCount(argv[++i], 0, MAX_TRAIL_LENGTH, &trailLength)) {
+                return usage(argv[0], std::string("--trail-length must be an integer between 0 and 4096: ") + argv[i]);
+            }
+        }
+        if (arg == "--headless") {
+            headless = true;
+        }
+        if (arg == "--size" && i + 1 < argc) {
+            if (!parseSize(argv[++i], 16384, &headlessOptions.width, &headlessOptions.height)) {
+                return usage(argv[0], std::string("--size must be WxH with both sides between 1 and 16384: ") + argv[i]);
+            }
+        }
+        if (arg == "--frames" && i + 1 < argc) {
+            if (!parseCount(argv[++i], 1, INT_MAX, &headlessOptions.frames)) {
+                return usage(argv[0], std::string("--frames must be a positive integer: ") + argv[i]);
+            }
+        }
+        if (arg == "--fps" && i + 1 < argc) {
+            float fps = 0.0f;
+            if (!parseNumber(argv[++i], &fps) || fps <= 0.0f) {
+                return usage(argv[0], std::string("--fps must be a positive number: ") + argv[i]);
+            }
+            headlessOptions.fps = fps;
+        }
+        if (arg == "--dump" && i + 1 < argc) {
+            headlessOptions.dumpPrefix = argv[++i];
+        }
+        if (arg == "--dump-format" && i + 1 < argc) {
+            const std::string format = argv[++i];
+            if (format != "png" && format != "rgba") {
+                return usage(argv[0], "Unknown dump format: " + format);
+            }
+            headlessOptions.dumpRaw = format == "rgba";
+        }
+        if (arg == "--timing" && i + 1 < argc) {
+            headlessOptions.timingFile = argv[++i];
+        }
+        if (arg == "--hz" && i + 1 < argc) {
+            float hz = 0.0f;
+            if (!parseNumber(argv[++i], &hz) || hz <= 0.0f) {
+                return usage(argv[0], std::string("--hz must be a positive number: ") + argv[i]);
+            }
+            laneConfig.dt = 1.0f / hz;
+        }
+        if (arg == "--omega" && i + 1 < argc) {
+            if (!parseNumber(argv[++i], &laneConfig.omega)) {
+                return usage(argv[0], std::string("--omega must be a number: ") + argv[i]);
+            }
+        }
+        if (arg == "--dynamics" && i + 1 < argc) {
+            if (!findDynamics(argv[++i], &laneConfig.dynamics)) {
+                return usage(argv[0], std::string("Unknown dynamics: ") + argv[i]);
+            }
+        }
+    }
+    if (headless) {
+        headlessOptions.replayFile = replayFile;
+        return runHeadless(headlessOptions, laneConfig);
+    }
+    if (!replayFile.empty()) {
+        return replay(replayFile, printChecksums);
+    }
+    
+    game = Game(laneConfig);
+    simClock.setDt(laneConfig.dt);
+    if (!recordFile.empty()) {
+        if (!inputRecorder.open(recordFile, laneConfig)) {
+            fprintf(stderr, "Failed to open input log: %s\n", recordFile.c_str());
+            return 1;
+        }
+        game.setRecorder(&inputRecorder);
+    }
+    
     // OpenGLを初期化する
     if (glfwInit() == GL_FALSE) {
         fprintf(stderr, "Initialization failed!\n");
@@ -759,21 +3116,58 @@ int main(int argc, char **argv) {
     // キーボードコールバック関数の登録
     glfwSetKeyCallback(window, keyboardCallback);
     
+    // Retina ディスプレイなどではウィンドウの大きさとピクセル数が違う
+    glfwGetFramebufferSize(window, &FB_WIDTH, &FB_HEIGHT);
     initializeGL();
+    printf("shaders: %d compiled, %d loaded from %s\n", programCache.numCompiled, programCache.numLoaded, SHADER_CACHE_DIRECTORY);
+    if (benchObjects > 0) {
+        benchDraw(benchObjects);
+        glfwSetWindowShouldClose(window, GL_TRUE);
+    }
 
     // メインループ
+    double prevTime = glfwGetTime();
+    double statsTime = prevTime;
+    int statsFrames = 0;
+    RenderStats statsTotal;
+    statsTotal.reset();
     while (glfwWindowShouldClose(window) == GL_FALSE) {
-        
-        // 描画
-        paintGL();
+        const double currentTime = glfwGetTime();
         
         // アニメーション
-        animate();
+        animate(window, currentTime - prevTime);
+        prevTime = currentTime;
         
-        keyboard(window);
+        // 描画
+        paintGL();
+        if (printStats) {
+            statsTotal.add(renderStats);
+            statsFrames++;
+            if (currentTime - statsTime >= 1.0) {
+                printf("render: %.1f visible, %.1f culled, %.1f draws (%.1f commands), %.1f program / %.1f texture / %.1f VAO changes per frame\n",
+                       (double)statsTotal.visible / statsFrames, (double)statsTotal.culled / statsFrames,
+                       (double)statsTotal.drawCalls / statsFrames, (double)statsTotal.commands / statsFrames,
+                       (double)statsTotal.programChanges / statsFrames,
+                       (double)statsTotal.textureChanges / statsFrames, (double)statsTotal.vaoChanges / statsFrames);
+                statsTotal.reset();
+                statsFrames = 0;
+                statsTime = currentTime;
+            }
+        }
         
         // 描画用バッファの切り替え
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    
+    if (trailLength > 0) {
+        trails.release();
+    }
+    bowlingBalls.release();
+    palette.release();
+    indirectDraws.release();
+    objectUniforms.release();
+    frameUniforms.release();
+    programCache.release();
+    meshCache.release();
 }
@@ -7,14 +7,26 @@ layout(location = 3) in vec2 f_texcoord;
 
 layout(location = 0) out vec4 out_color;
 
-uniform vec3 u_ambiColor;
-uniform vec3 u_diffColor;
-uniform vec3 u_specColor;
-uniform float u_shininess;
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び)
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
 
-uniform bool u_isTextured;
 uniform sampler2D u_texture;
 
+// 色見本のテクスチャ配列 (u_paletteIndex が負なら u_texture を使う)
+uniform sampler2DArray u_palette;
+
 void main(void) {
     vec3 V = normalize(-f_posViewSpace);
     vec3 N = normalize(f_normViewSpace);
@@ -24,13 +36,15 @@ void main(void) {
     float ndotl = max(0.0, dot(N, L));
     float ndoth = max(0.0, dot(N, H));
 
-    vec3 diffuse = u_diffColor;
-    if (u_isTextured) {
+    vec3 diffuse = u_diffColor.rgb;
+    if (u_paletteIndex >= 0) {
+        diffuse *= texture(u_palette, vec3(f_texcoord, float(u_paletteIndex))).rgb;
+    } else if (u_isTextured != 0) {
         diffuse *= texture(u_texture, f_texcoord).rgb;
     }
 
-    vec3 specular = u_specColor;
-    vec3 ambient = u_ambiColor;
+    vec3 specular = u_specColor.rgb;
+    vec3 ambient = u_ambiColor.rgb;
 
     out_color.rgb = ambient + diffuse * ndotl + specular * pow(ndoth, u_shininess);
     out_color.a = 1.0;
@@ -1,5 +1,9 @@
 #version 410
 
+// 頂点シェーダからビューポートを選べれば, 1回の描画で全部のビューに描く
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_texcoord;
@@ -9,17 +13,52 @@ layout(location = 1) out vec3 f_normViewSpace;
 layout(location = 2) out vec3 f_lightPosViewSpace;
 layout(location = 3) out vec2 f_texcoord;
 
-uniform mat4 u_lightMat;
-uniform mat4 u_mvpMat;
-uniform mat4 u_mvMat;
-uniform mat4 u_normMat;
-uniform vec3 u_lightPos;
+// ビューごとの値 (main.cpp の ViewUniforms と同じ並び)
+struct ViewValues {
+    mat4 viewMat;
+    mat4 projMat;
+    vec4 lightPosViewSpace;
+};
+
+// フレームごとの値 (main.cpp の FrameUniforms と同じ並び).
+// インスタンス i は u_viewBase + i % u_viewsPerDraw 番目のビューに描く
+layout(std140) uniform FrameUniforms {
+    ViewValues u_views[2];
+    int u_viewsPerDraw;
+    int u_viewBase;
+};
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び)
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
 
 void main(void) {
-    gl_Position = u_mvpMat * vec4(in_position, 1.0);
+    // 詰めた頂点は [-1, 1] や [0, 1] に正規化されて届くので, メッシュの範囲に戻す
+    // (詰めていないメッシュは offset = 0, scale = 1)
+    vec3 position = u_positionOffset.xyz + u_positionScale.xyz * in_position;
+    vec2 texcoord = u_texcoordTransform.xy + u_texcoordTransform.zw * in_texcoord;
+
+    int view = u_viewBase + gl_InstanceID % u_viewsPerDraw;
+    mat4 viewMat = u_views[view].viewMat;
+    vec4 posViewSpace = viewMat * (u_modelMat * vec4(position, 1.0));
+    gl_Position = u_views[view].projMat * posViewSpace;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_viewport_index)
+    gl_ViewportIndex = view;
+#endif
 
-    f_posViewSpace = (u_mvMat * vec4(in_position, 1.0)).xyz;
-    f_normViewSpace = (u_normMat * vec4(in_normal, 0.0)).xyz;
-    f_lightPosViewSpace = (u_lightMat * vec4(u_lightPos, 1.0)).xyz;
-    f_texcoord = in_texcoord;
+    f_posViewSpace = posViewSpace.xyz;
+    f_normViewSpace = mat3(viewMat) * (u_normModelMat * vec4(in_normal, 0.0)).xyz;
+    f_lightPosViewSpace = u_views[view].lightPosViewSpace.xyz;
+    f_texcoord = texcoord;
 }
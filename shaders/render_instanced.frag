@@ -0,0 +1,44 @@
+#version 410
+
+layout(location = 0) in vec3 f_posViewSpace;
+layout(location = 1) in vec3 f_normViewSpace;
+layout(location = 2) in vec3 f_lightPosViewSpace;
+layout(location = 3) in vec2 f_texcoord;
+layout(location = 4) flat in float f_colorIndex;
+
+layout(location = 0) out vec4 out_color;
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び)
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
+
+// ボールの色 (色見本のテクスチャ配列)
+uniform sampler2DArray u_palette;
+
+void main(void) {
+    vec3 V = normalize(-f_posViewSpace);
+    vec3 N = normalize(f_normViewSpace);
+    vec3 L = normalize(f_lightPosViewSpace - f_posViewSpace);
+    vec3 H = normalize(V + L);
+
+    float ndotl = max(0.0, dot(N, L));
+    float ndoth = max(0.0, dot(N, H));
+
+    vec3 diffuse = u_diffColor.rgb * texture(u_palette, vec3(f_texcoord, f_colorIndex)).rgb;
+    vec3 specular = u_specColor.rgb;
+    vec3 ambient = u_ambiColor.rgb;
+
+    out_color.rgb = ambient + diffuse * ndotl + specular * pow(ndoth, u_shininess);
+    out_color.a = 1.0;
+}
@@ -0,0 +1,52 @@
+#version 430
+
+layout(location = 0) in vec3 f_posViewSpace;
+layout(location = 1) in vec3 f_normViewSpace;
+layout(location = 2) in vec3 f_lightPosViewSpace;
+layout(location = 3) in vec2 f_texcoord;
+layout(location = 4) flat in float f_colorIndex;
+layout(location = 5) flat in int f_drawId;
+
+layout(location = 0) out vec4 out_color;
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び). gl_DrawIDARB 番目が自分の値
+struct ObjectValues {
+    mat4 modelMat;
+    mat4 normModelMat;
+    vec4 ambiColor;
+    vec4 diffColor;
+    vec4 specColor;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 texcoordTransform;
+    float shininess;
+    int isTextured;
+    int paletteIndex;
+    int padding;
+};
+
+layout(std430, binding = 0) readonly buffer DrawData {
+    ObjectValues u_objects[];
+};
+
+// ボールの色 (色見本のテクスチャ配列)
+uniform sampler2DArray u_palette;
+
+void main(void) {
+    ObjectValues object = u_objects[f_drawId];
+
+    vec3 V = normalize(-f_posViewSpace);
+    vec3 N = normalize(f_normViewSpace);
+    vec3 L = normalize(f_lightPosViewSpace - f_posViewSpace);
+    vec3 H = normalize(V + L);
+
+    float ndotl = max(0.0, dot(N, L));
+    float ndoth = max(0.0, dot(N, H));
+
+    vec3 diffuse = object.diffColor.rgb * texture(u_palette, vec3(f_texcoord, f_colorIndex)).rgb;
+    vec3 specular = object.specColor.rgb;
+    vec3 ambient = object.ambiColor.rgb;
+
+    out_color.rgb = ambient + diffuse * ndotl + specular * pow(ndoth, object.shininess);
+    out_color.a = 1.0;
+}
@@ -0,0 +1,80 @@
+#version 430
+#extension GL_ARB_shader_draw_parameters : require
+// 頂点シェーダからビューポートを選べれば, 1回の描画で全部のビューに描く
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoord;
+
+// インスタンスごとの値 (描画命令の baseInstance から読む)
+layout(location = 3) in mat4 in_modelMat;
+layout(location = 7) in float in_colorIndex;
+
+layout(location = 0) out vec3 f_posViewSpace;
+layout(location = 1) out vec3 f_normViewSpace;
+layout(location = 2) out vec3 f_lightPosViewSpace;
+layout(location = 3) out vec2 f_texcoord;
+layout(location = 4) flat out float f_colorIndex;
+layout(location = 5) flat out int f_drawId;
+
+// ビューごとの値 (main.cpp の ViewUniforms と同じ並び)
+struct ViewValues {
+    mat4 viewMat;
+    mat4 projMat;
+    vec4 lightPosViewSpace;
+};
+
+// フレームごとの値 (main.cpp の FrameUniforms と同じ並び).
+// インスタンス i は u_viewBase + i % u_viewsPerDraw 番目のビューに描く
+layout(std140) uniform FrameUniforms {
+    ViewValues u_views[2];
+    int u_viewsPerDraw;
+    int u_viewBase;
+};
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び). gl_DrawIDARB 番目が自分の値
+struct ObjectValues {
+    mat4 modelMat;
+    mat4 normModelMat;
+    vec4 ambiColor;
+    vec4 diffColor;
+    vec4 specColor;
+    vec4 positionOffset;
+    vec4 positionScale;
+    vec4 texcoordTransform;
+    float shininess;
+    int isTextured;
+    int paletteIndex;
+    int padding;
+};
+
+layout(std430, binding = 0) readonly buffer DrawData {
+    ObjectValues u_objects[];
+};
+
+void main(void) {
+    ObjectValues object = u_objects[gl_DrawIDARB];
+
+    // 詰めた頂点をメッシュの範囲に戻す (render.vert と同じ)
+    vec3 position = object.positionOffset.xyz + object.positionScale.xyz * in_position;
+    vec2 texcoord = object.texcoordTransform.xy + object.texcoordTransform.zw * in_texcoord;
+
+    // 属性はビューの数ずつ同じボールの値が続く (glVertexAttribDivisor) ので, 余りでビューを選ぶ
+    int view = u_viewBase + gl_InstanceID % u_viewsPerDraw;
+    mat4 mvMat = u_views[view].viewMat * in_modelMat;
+    vec4 posViewSpace = mvMat * vec4(position, 1.0);
+    gl_Position = u_views[view].projMat * posViewSpace;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_viewport_index)
+    gl_ViewportIndex = view;
+#endif
+
+    // ボールは等方的な拡大と回転だけなので, 法線はモデルビュー行列でそのまま変換できる
+    f_posViewSpace = posViewSpace.xyz;
+    f_normViewSpace = mat3(mvMat) * in_normal;
+    f_lightPosViewSpace = u_views[view].lightPosViewSpace.xyz;
+    f_texcoord = texcoord;
+    f_colorIndex = in_colorIndex;
+    f_drawId = gl_DrawIDARB;
+}
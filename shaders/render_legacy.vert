@@ -0,0 +1,35 @@
+#version 410
+
+// --bench-draw の lookup でだけ使う, uniform ブロックを使う前の render.vert.
+// 値はオブジェクトを描くたびに glUniform* で1つずつ送る
+
+layout(location = 0) in vec3 in_position;
+layout(location = 1) in vec3 in_normal;
+layout(location = 2) in vec2 in_texcoord;
+
+layout(location = 0) out vec3 f_posViewSpace;
+layout(location = 1) out vec3 f_normViewSpace;
+layout(location = 2) out vec3 f_lightPosViewSpace;
+layout(location = 3) out vec2 f_texcoord;
+
+uniform mat4 u_lightMat;
+uniform mat4 u_mvpMat;
+uniform mat4 u_mvMat;
+uniform mat4 u_normMat;
+uniform vec3 u_lightPos;
+
+// 詰めた頂点を戻す係数 (render.vert と同じ)
+uniform vec3 u_positionOffset;
+uniform vec3 u_positionScale;
+uniform vec4 u_texcoordTransform;
+
+void main(void) {
+    vec3 position = u_positionOffset + u_positionScale * in_position;
+
+    gl_Position = u_mvpMat * vec4(position, 1.0);
+
+    f_posViewSpace = (u_mvMat * vec4(position, 1.0)).xyz;
+    f_normViewSpace = (u_normMat * vec4(in_normal, 0.0)).xyz;
+    f_lightPosViewSpace = (u_lightMat * vec4(u_lightPos, 1.0)).xyz;
+    f_texcoord = u_texcoordTransform.xy + u_texcoordTransform.zw * in_texcoord;
+}
@@ -4,11 +4,25 @@ layout(location = 3) in vec2 f_texcoord;
 
 layout(location = 0) out vec4 out_color;
 
-uniform bool u_isTextured;
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び)
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
+
 uniform sampler2D u_texture;
 
 void main(void) {
-    if (u_isTextured) {
+    if (u_isTextured != 0) {
         out_color = texture(u_texture, f_texcoord);
     }
 }
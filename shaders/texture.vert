@@ -1,15 +1,36 @@
 #version 410
 
+// 頂点シェーダからビューポートを選べれば, 1回の描画で全部のビューに描く
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
 layout(location = 0) in vec3 in_position;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec2 in_texcoord;
 
 layout(location = 3) out vec2 f_texcoord;
 
-uniform mat4 u_mvpMat;
+// フレームごとの値のうち, ビューの選び方だけを使う (main.cpp の FrameUniforms と同じ並び)
+struct ViewValues {
+    mat4 viewMat;
+    mat4 projMat;
+    vec4 lightPosViewSpace;
+};
+
+layout(std140) uniform FrameUniforms {
+    ViewValues u_views[2];
+    int u_viewsPerDraw;
+    int u_viewBase;
+};
 
 void main(void) {
-    gl_Position = vec4(in_position, 1.0);
+    // 背景はビューの深度の範囲の一番奥に置く (重なったビューの背景が, 下のビューの物を隠すように)
+    gl_Position = vec4(in_position.xy, 1.0, 1.0);
+
+    int view = u_viewBase + gl_InstanceID % u_viewsPerDraw;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_viewport_index)
+    gl_ViewportIndex = view;
+#endif
 
     f_texcoord = in_position.xy * 0.5 + 0.5;
     f_texcoord.y = 1.0 - f_texcoord.y;
@@ -0,0 +1,25 @@
+#version 410
+
+layout(location = 0) in float f_age;
+
+layout(location = 0) out vec4 out_color;
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び)
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
+
+void main(void) {
+    // 古い位置ほど薄くする
+    out_color = vec4(u_diffColor.rgb, u_diffColor.a * (1.0 - f_age));
+}
@@ -0,0 +1,49 @@
+#version 410
+
+// 頂点シェーダからビューポートを選べれば, 1回の描画で全部のビューに描く
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
+layout(location = 0) in vec3 in_position;   // 円盤に固定した座標系での位置
+layout(location = 1) in float in_age;       // いまの位置が 0, 一番古い位置が 1
+
+layout(location = 0) out float f_age;
+
+// ビューごとの値 (main.cpp の ViewUniforms と同じ並び)
+struct ViewValues {
+    mat4 viewMat;
+    mat4 projMat;
+    vec4 lightPosViewSpace;
+};
+
+// フレームごとの値 (main.cpp の FrameUniforms と同じ並び).
+// インスタンス i は u_viewBase + i % u_viewsPerDraw 番目のビューに描く
+layout(std140) uniform FrameUniforms {
+    ViewValues u_views[2];
+    int u_viewsPerDraw;
+    int u_viewBase;
+};
+
+// オブジェクトごとの値 (main.cpp の ObjectUniforms と同じ並び). u_modelMat は円盤の回転
+layout(std140) uniform ObjectUniforms {
+    mat4 u_modelMat;
+    mat4 u_normModelMat;
+    vec4 u_ambiColor;
+    vec4 u_diffColor;
+    vec4 u_specColor;
+    vec4 u_positionOffset;
+    vec4 u_positionScale;
+    vec4 u_texcoordTransform;
+    float u_shininess;
+    int u_isTextured;
+    int u_paletteIndex;
+};
+
+void main(void) {
+    int view = u_viewBase + gl_InstanceID % u_viewsPerDraw;
+    gl_Position = u_views[view].projMat * (u_views[view].viewMat * (u_modelMat * vec4(in_position, 1.0)));
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_viewport_index)
+    gl_ViewportIndex = view;
+#endif
+    f_age = in_age;
+}
@@ -0,0 +1,36 @@
+// ThreadPool::run() を間を空けずに何度も呼び, どのタスクもちょうど1回ずつ呼ばれることを確かめる.
+// スレッドの数をタスクの数より多くして, 前の run() を寝過ごしたスレッドが次の run() と重なるようにする.
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+#include "../tools/thread_pool.h"
+
+int main() {
+    const int NUM_THREADS = 16;
+    const int NUM_RUNS = 20000;
+    const int MAX_TASKS = 5;
+
+    ThreadPool pool(NUM_THREADS);
+    std::vector<std::atomic<int> > calls(MAX_TASKS);
+    int failures = 0;
+    for (int r = 0; r < NUM_RUNS; r++) {
+        const int numTasks = 1 + r % MAX_TASKS;
+        for (int t = 0; t < MAX_TASKS; t++) {
+            calls[t] = 0;
+        }
+        pool.run(numTasks, [&calls](int task, int) { calls[task]++; });
+        for (int t = 0; t < MAX_TASKS; t++) {
+            const int expected = t < numTasks ? 1 : 0;
+            if (calls[t] != expected) {
+                if (failures < 10) {
+                    fprintf(stderr, "run %d: task %d was called %d times (expected %d)\n", r, t, (int)calls[t], expected);
+                }
+                failures++;
+            }
+        }
+    }
+
+    printf("%d runs on %d threads, %d failures\n", NUM_RUNS, pool.numThreads(), failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+// ボールの積分カーネルのマイクロベンチマーク
+//
+//   $ ./coriolis_bench [ボールの数] [ステップ数]
+//
+// 使える実装ごとに 1秒あたりに進めたボールの数を表示し,
+// 結果がスカラー版とビット単位で一致するかも確かめる.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "core/integrator.h"
+#include "core/lane.h"
+
+static const float PI = 4.0 * std::atan(1.0);
+
+// 円盤上のいろいろな位置・向きから投げたボールを用意する
+static void fillBalls(BallStore &balls, int count, const LaneConfig &config) {
+    balls.clear();
+    balls.reserve(count);
+    srand(1234);
+    for (int n = 0; n < count; n++) {
+        const float theta = 2.0f * PI * rand() / (float)RAND_MAX;
+        const float arrowAngle = 3.0f * rand() / (float)RAND_MAX - 1.5f;
+        const float goalAngle = theta - (PI - 2.0f * arrowAngle);
+        const float r = config.releaseRadius;
+
+        balls.push();
+        const int i = balls.size() - 1;
+        balls.run()[i] = 0.0f;
+        balls.speedY()[i] = 0.0f;
+        balls.startX()[i] = r * std::sin(theta);
+        balls.startZ()[i] = r * std::cos(theta);
+        balls.goalX()[i] = r * std::sin(goalAngle);
+        balls.goalZ()[i] = r * std::cos(goalAngle);
+        balls.posX()[i] = balls.startX()[i];
+        balls.posY()[i] = config.releaseHeight;
+        balls.posZ()[i] = balls.startZ()[i];
+        balls.spin()[i] = 0.0f;
+        balls.impact()[i] = -1.0f;
+        balls.axisX()[i] = std::sin(theta) / 2.0f;
+        balls.axisZ()[i] = std::cos(theta) / 2.0f;
+    }
+}
+
+static bool sameBits(const BallStore &a, const BallStore &b) {
+    for (int c = 0; c < BallStore::NUM_COLUMNS; c++) {
+        const BallStore::Column col = (BallStore::Column)c;
+        if (memcmp(a.column(col), b.column(col), sizeof(float) * a.size()) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    const int numBalls = argc > 1 ? atoi(argv[1]) : 100000;
+    const int numSteps = argc > 2 ? atoi(argv[2]) : 1000;
+
+    LaneConfig config;
+    IntegrateParams params;
+    params.speed = BALL_SPEEDS[5] * config.dt;
+    params.spinStep = config.spinRate * config.dt;
+    params.diskRadius2 = config.diskRadius * config.diskRadius;
+    params.gravity = config.gravity * config.dt * config.dt;
+    params.pin[0] = 0.0f;
+    params.pin[1] = config.pinHeight;
+    params.pin[2] = -config.pinRadius;
+    params.hitRadius2 = config.hitRadius * config.hitRadius;
+
+    BallStore initial;
+    fillBalls(initial, numBalls, config);
+
+    printf("balls: %d, steps: %d\n", numBalls, numSteps);
+
+    BallStore reference;
+    double scalarRate = 0.0;
+    for (int k = 0; k < NUM_INTEGRATORS; k++) {
+        const IntegratorKind kind = (IntegratorKind)k;
+        if (!integratorSupported(kind)) {
+            printf("%-8s not supported on this CPU\n", integratorName(kind));
+            continue;
+        }
+
+        BallStore balls = initial;
+        const IntegrateFunc integrate = integratorFunc(kind);
+        long long hits = 0;
+
+        const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        for (int s = 0; s < numSteps; s++) {
+            params.pinPrev[0] = -config.pinRadius * std::sin((s - 1) * config.omega * config.dt);
+            params.pinPrev[1] = config.pinHeight;
+            params.pinPrev[2] = -config.pinRadius * std::cos((s - 1) * config.omega * config.dt);
+            params.pin[0] = -config.pinRadius * std::sin(s * config.omega * config.dt);
+            params.pin[2] = -config.pinRadius * std::cos(s * config.omega * config.dt);
+            hits += integrate(ballSpan(balls), params);
+        }
+        const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+        const double seconds = std::chrono::duration<double>(end - start).count();
+        const double rate = (double)numBalls * numSteps / seconds;
+        if (kind == INTEGRATOR_SCALAR) {
+            reference = balls;
+            scalarRate = rate;
+        }
+
+        printf("%-8s %8.3f ms  %12.4g balls/s  x%.2f  hits %lld  %s\n",
+               integratorName(kind), seconds * 1000.0, rate, rate / scalarRate, hits,
+               sameBits(balls, reference) ? "bit-exact" : "MISMATCH");
+    }
+
+    return 0;
+}
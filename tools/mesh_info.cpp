@@ -0,0 +1,61 @@
+// OBJ ファイルを描画するときと同じように読み込み, 頂点をまとめて並べ替え, 詰めて LOD を作った結果を表示する
+//
+//   $ ./coriolis_meshinfo data/Bowling_ball/Bowling_Ball.obj data/stickman.OBJ ...
+//
+// ゲームを起動したときに出す1行のまとめと同じものを, ウィンドウを開かずに確かめられる.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+#include "core/mesh_data.h"
+#include "core/mesh_optimize.h"
+#include "core/mesh_simplify.h"
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: coriolis_meshinfo file.obj [file.obj ...]\n");
+        return 1;
+    }
+
+    for (int a = 1; a < argc; a++) {
+        const std::string filename = argv[a];
+        MeshData mesh;
+        std::string err;
+        const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+        if (!loadMeshData(filename, &mesh, &err)) {
+            fprintf(stderr, "Failed to load OBJ file: %s\n%s", filename.c_str(), err.c_str());
+            return 1;
+        }
+        const std::chrono::high_resolution_clock::time_point loaded = std::chrono::high_resolution_clock::now();
+        const float acmrBefore = computeACMR(mesh.indices, mesh.vertices.size());
+        optimizeMesh(&mesh);
+        const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+        printf("%s\n", meshReport(filename, mesh).c_str());
+        printf("    %d triangles, ACMR %.3f -> %.3f (%d-entry FIFO), loaded in %.1f ms, optimized in %.1f ms\n",
+               (int)mesh.indices.size() / 3, acmrBefore, computeACMR(mesh.indices, mesh.vertices.size()), VERTEX_CACHE_SIZE,
+               std::chrono::duration<double, std::milli>(loaded - start).count(),
+               std::chrono::duration<double, std::milli>(end - loaded).count());
+
+        std::vector<PackedVertex> packed;
+        VertexQuantization quantization;
+        const bool usePacked = packVertices(mesh, &packed, &quantization);
+        printf("    %s vertices (%d bytes each), packed error: position %.2g of diagonal, texcoord %.2g\n",
+               usePacked ? "packed" : "float", usePacked ? (int)sizeof(PackedVertex) : (int)sizeof(MeshVertex),
+               quantization.positionError, quantization.texcoordError);
+        const MeshBounds bounds = computeBounds(mesh);
+        printf("    bounds: (%.3g, %.3g, %.3g) - (%.3g, %.3g, %.3g), sphere radius %.3g\n",
+               bounds.min[0], bounds.min[1], bounds.min[2], bounds.max[0], bounds.max[1], bounds.max[2], bounds.radius);
+
+        const std::chrono::high_resolution_clock::time_point lodStart = std::chrono::high_resolution_clock::now();
+        buildLods(&mesh);
+        const std::chrono::high_resolution_clock::time_point lodEnd = std::chrono::high_resolution_clock::now();
+        printf("    LOD (built in %.1f ms):", std::chrono::duration<double, std::milli>(lodEnd - lodStart).count());
+        for (size_t l = 0; l < mesh.lods.size(); l++) {
+            printf(" %d tris (error %.3g)", (int)mesh.lods[l].indexCount / 3, mesh.lods[l].error);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// 記録した入力ログを描画せずに全速力で再生し, ステップごとのチェックサムを確かめる
+//
+//   $ ./coriolis_replay input.cril [--integrator scalar|sse4|avx2] [--checksums]
+//   $ ./coriolis_replay --generate input.cril [--ticks 36000] [--seed 1] [--hz 60] [--dynamics rk4]
+//
+// ログはゲームを --record input.cril を付けて起動すると記録できる.
+// --generate はキーを適当に押し続ける人の代わりに入力を作って記録する (性能の回帰を測るため).
+// 記録したときと違うカーネルで再生してもチェックサムが一致することを確かめられる.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "core/game.h"
+#include "core/input_log.h"
+
+// 押すキーを乱数で選びながら ticks ステップ分遊んだ入力を記録する
+static void generate(const std::string &filename, const LaneConfig &config, unsigned long long ticks, unsigned int seed) {
+    InputRecorder recorder;
+    if (!recorder.open(filename, config)) {
+        fprintf(stderr, "Failed to open input log: %s\n", filename.c_str());
+        exit(1);
+    }
+
+    Game game(config);
+    game.setRecorder(&recorder);
+    game.press(PRESSED_ENTER);
+
+    srand(seed);
+    unsigned int heldKeys = 0;
+    while (game.tick() < ticks) {
+        // 押しているキーは平均で1秒くらい押し続ける
+        if (rand() % 60 == 0) {
+            heldKeys = rand() % 16;
+        }
+        if (rand() % 20 == 0) {
+            game.press(PRESSED_ENTER);
+        }
+        if (rand() % 600 == 0) {
+            game.press(PRESSED_SPACE);
+        }
+        game.step(heldKeys);
+    }
+    recorder.close();
+
+    printf("generated %llu ticks, %d balls rolling at the end\n", game.tick(), game.lane().numBalls());
+}
+
+int main(int argc, char **argv) {
+    std::string filename;
+    std::string generateFile;
+    std::string integrator;
+    bool printChecksums = false;
+    unsigned long long ticks = 36000;
+    unsigned int seed = 1;
+    LaneConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--generate" && i + 1 < argc) {
+            generateFile = argv[++i];
+        } else if (arg == "--ticks" && i + 1 < argc) {
+            ticks = strtoull(argv[++i], NULL, 10);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = (unsigned int)atoi(argv[++i]);
+        } else if (arg == "--hz" && i + 1 < argc) {
+            char *end = NULL;
+            const float hz = (float)strtod(argv[++i], &end);
+            if (*end != '\0' || !(hz > 0.0f && hz < INFINITY)) {
+                fprintf(stderr, "--hz must be a positive number: %s\n", argv[i]);
+                exit(1);
+            }
+            config.dt = 1.0f / hz;
+        } else if (arg == "--dynamics" && i + 1 < argc) {
+            if (!findDynamics(argv[++i], &config.dynamics)) {
+                fprintf(stderr, "Unknown dynamics: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (arg == "--integrator" && i + 1 < argc) {
+            integrator = argv[++i];
+        } else if (arg == "--checksums") {
+            printChecksums = true;
+        } else if (filename.empty()) {
+            filename = arg;
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            exit(1);
+        }
+    }
+
+    if (!generateFile.empty()) {
+        generate(generateFile, config, ticks, seed);
+        return 0;
+    }
+    if (filename.empty()) {
+        fprintf(stderr, "usage: coriolis_replay input.cril [--integrator scalar|sse4|avx2] [--checksums]\n");
+        exit(1);
+    }
+
+    InputLog log;
+    if (!log.load(filename)) {
+        fprintf(stderr, "Failed to load input log: %s\n", filename.c_str());
+        exit(1);
+    }
+
+    Game game(log.config());
+    for (int k = 0; k < NUM_INTEGRATORS; k++) {
+        if (integrator == integratorName((IntegratorKind)k)) {
+            game.lane().setIntegrator((IntegratorKind)k);
+        }
+    }
+
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    const ReplayResult result = replayInputLog(log, game, printChecksums ? stdout : NULL);
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+    const double seconds = std::chrono::duration<double>(end - start).count();
+
+    printf("%s, %s: replayed %llu ticks (%d events) in %.3f s, %.4g ticks/s\n",
+           dynamicsName(log.config().dynamics), integratorName(game.lane().integrator()),
+           result.ticks, result.events, seconds, result.ticks / seconds);
+    if (result.desync) {
+        fprintf(stderr, "Input log is out of sync at tick %llu!\n", game.tick());
+        return 1;
+    }
+    if (result.firstMismatch >= 0) {
+        fprintf(stderr, "Checksum mismatch at tick %lld!\n", result.firstMismatch);
+        return 1;
+    }
+    printf("%d checksums match\n", result.checksums);
+    return 0;
+}
@@ -0,0 +1,258 @@
+// 投げる向き × ボールの速さ × 投げるときの円盤の角度 の格子でピンに当たる確率を求める
+//
+//   $ ./coriolis_sweep [--angles 121] [--phases 72] [--samples 4] [--threads 0]
+//                      [--hz 60] [--omega 1.047] [--dynamics chord|euler|rk4] [--solver]
+//                      [--format csv|bin] [-o sweep.csv]
+//
+// 向きは [-1.5, 1.5] を --angles 個の区間に, 円盤の角度は [0, 2PI) を --phases 個の区間に分ける.
+// 各セルでは区間の中で向きを --samples 通りにずらして投げ, 当たった割合を確率とする.
+// (速さ, 円盤の角度) ごとに1つのタスクにして, その行の全ての向きのボールを1つのレーンで同時に転がす.
+// --solver を付けるとステップを刻まずに solveThrow() で求める (直線の補間のときだけ).
+//
+// 出力 (CSV): speed_index,arrow_angle,release_theta,hit_probability (各区間の中央の値)
+// 出力 (bin): 以下をリトルエンディアンで並べたもの
+//   char[4] "CSWP", uint32 version (=1),
+//   uint32 numSpeeds, numPhases, numAngles, samples,
+//   float angleMin, angleMax, omega, dt, uint32 dynamics,
+//   float probability[numSpeeds][numPhases][numAngles]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "core/lane.h"
+#include "core/throw_solver.h"
+#include "tools/thread_pool.h"
+
+static const float PI = 4.0 * std::atan(1.0);
+static const float ANGLE_MIN = -1.5f;
+static const float ANGLE_MAX = 1.5f;
+
+struct SweepConfig {
+    int numAngles;
+    int numPhases;
+    int samples;
+    bool solver;
+    LaneConfig lane;
+
+    float angleWidth() const { return (ANGLE_MAX - ANGLE_MIN) / numAngles; }
+    float arrowAngle(int a, int k) const {
+        return ANGLE_MIN + angleWidth() * (a + (k + 0.5f) / samples);
+    }
+    float releaseTheta(int p) const {
+        return 2.0f * PI * (p + 0.5f) / numPhases;
+    }
+};
+
+// 1行 (ある速さ, ある円盤の角度) の全ての向きのボールを同時に投げてステップを刻む
+static void sweepRowStepped(const SweepConfig &config, Lane &lane, int speedIndex, int phase,
+                            std::vector<unsigned char> &hit, float *probability) {
+    const int numBalls = config.numAngles * config.samples;
+    hit.assign(numBalls, 0);
+
+    lane.reset();
+    lane.setTheta(config.releaseTheta(phase));
+    lane.setSpeedIndex(speedIndex);
+    BallHandle first = 0;
+    for (int a = 0; a < config.numAngles; a++) {
+        for (int k = 0; k < config.samples; k++) {
+            BallHandle handle;
+            lane.throwBall(config.arrowAngle(a, k), &handle);
+            if (a == 0 && k == 0) {
+                first = handle;
+            }
+        }
+    }
+
+    while (lane.numBalls() > 0) {
+        lane.step();
+        if (!lane.hit()) {
+            continue;
+        }
+        const BallStore &balls = lane.balls();
+        for (int i = 0; i < balls.size(); i++) {
+            if (balls.impact()[i] >= 0.0f) {
+                hit[balls.handleAt(i) - first] = 1;
+            }
+        }
+    }
+
+    for (int a = 0; a < config.numAngles; a++) {
+        int hits = 0;
+        for (int k = 0; k < config.samples; k++) {
+            hits += hit[a * config.samples + k];
+        }
+        probability[a] = (float)hits / config.samples;
+    }
+}
+
+static void sweepRowSolver(const SweepConfig &config, int speedIndex, int phase, float *probability) {
+    const float theta = config.releaseTheta(phase);
+    for (int a = 0; a < config.numAngles; a++) {
+        int hits = 0;
+        for (int k = 0; k < config.samples; k++) {
+            hits += solveThrow(config.lane, config.arrowAngle(a, k), speedIndex, theta).hit ? 1 : 0;
+        }
+        probability[a] = (float)hits / config.samples;
+    }
+}
+
+static bool writeCSV(const std::string &path, const SweepConfig &config, const std::vector<float> &table) {
+    FILE *fp = fopen(path.c_str(), "w");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "speed_index,arrow_angle,release_theta,hit_probability\n");
+    for (int s = 0; s < NUM_BALL_SPEEDS; s++) {
+        for (int p = 0; p < config.numPhases; p++) {
+            const float *row = &table[((size_t)s * config.numPhases + p) * config.numAngles];
+            for (int a = 0; a < config.numAngles; a++) {
+                const float angle = ANGLE_MIN + config.angleWidth() * (a + 0.5f);
+                fprintf(fp, "%d,%.6f,%.6f,%g\n", s, angle, config.releaseTheta(p), row[a]);
+            }
+        }
+    }
+    fclose(fp);
+    return true;
+}
+
+static void writeU32(FILE *fp, uint32_t value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+static void writeF32(FILE *fp, float value) {
+    fwrite(&value, sizeof(value), 1, fp);
+}
+
+static bool writeBinary(const std::string &path, const SweepConfig &config, const std::vector<float> &table) {
+    FILE *fp = fopen(path.c_str(), "wb");
+    if (!fp) {
+        return false;
+    }
+    fwrite("CSWP", 1, 4, fp);
+    writeU32(fp, 1);
+    writeU32(fp, NUM_BALL_SPEEDS);
+    writeU32(fp, config.numPhases);
+    writeU32(fp, config.numAngles);
+    writeU32(fp, config.samples);
+    writeF32(fp, ANGLE_MIN);
+    writeF32(fp, ANGLE_MAX);
+    writeF32(fp, config.lane.omega);
+    writeF32(fp, config.lane.dt);
+    writeU32(fp, config.lane.dynamics);
+    fwrite(table.data(), sizeof(float), table.size(), fp);
+    const bool ok = !ferror(fp);
+    fclose(fp);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    SweepConfig config;
+    config.numAngles = 121;
+    config.numPhases = 72;
+    config.samples = 4;
+    config.solver = false;
+    int numThreads = 0;
+    std::string format = "csv";
+    std::string output;
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--angles" && i + 1 < argc) {
+            config.numAngles = atoi(argv[++i]);
+        } else if (arg == "--phases" && i + 1 < argc) {
+            config.numPhases = atoi(argv[++i]);
+        } else if (arg == "--samples" && i + 1 < argc) {
+            config.samples = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            numThreads = atoi(argv[++i]);
+        } else if (arg == "--hz" && i + 1 < argc) {
+            char *end = NULL;
+            const float hz = (float)strtod(argv[++i], &end);
+            if (*end != '\0' || !(hz > 0.0f && hz < INFINITY)) {
+                fprintf(stderr, "--hz must be a positive number: %s\n", argv[i]);
+                exit(1);
+            }
+            config.lane.dt = 1.0f / hz;
+        } else if (arg == "--omega" && i + 1 < argc) {
+            char *end = NULL;
+            config.lane.omega = (float)strtod(argv[++i], &end);
+            if (end == argv[i] || *end != '\0' || !std::isfinite(config.lane.omega)) {
+                fprintf(stderr, "--omega must be a number: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (arg == "--dynamics" && i + 1 < argc) {
+            if (!findDynamics(argv[++i], &config.lane.dynamics)) {
+                fprintf(stderr, "Unknown dynamics: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (arg == "--solver") {
+            config.solver = true;
+        } else if (arg == "--format" && i + 1 < argc) {
+            format = argv[++i];
+        } else if (arg == "-o" && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg.c_str());
+            exit(1);
+        }
+    }
+    if (config.numAngles <= 0 || config.numPhases <= 0 || config.samples <= 0) {
+        fprintf(stderr, "--angles, --phases and --samples must be positive!\n");
+        exit(1);
+    }
+    if (format != "csv" && format != "bin") {
+        fprintf(stderr, "Unknown format: %s\n", format.c_str());
+        exit(1);
+    }
+    if (config.solver && config.lane.dynamics != DYNAMICS_CHORD) {
+        fprintf(stderr, "--solver only supports the chord dynamics!\n");
+        exit(1);
+    }
+    if (output.empty()) {
+        output = "sweep." + format;
+    }
+
+    // 1行分のボールは全て同時に転がすので, その分の領域を前もって確保しておく
+    config.lane.ballBudget = std::max(config.lane.ballBudget, config.numAngles * config.samples);
+
+    ThreadPool pool(numThreads);
+    std::vector<Lane> lanes(pool.numThreads(), Lane(config.lane));
+    std::vector<std::vector<unsigned char> > hitFlags(pool.numThreads());
+    std::vector<float> table((size_t)NUM_BALL_SPEEDS * config.numPhases * config.numAngles);
+
+    const int numTasks = NUM_BALL_SPEEDS * config.numPhases;
+    const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+    pool.run(numTasks, [&](int task, int worker) {
+        const int speedIndex = task / config.numPhases;
+        const int phase = task % config.numPhases;
+        float *row = &table[(size_t)task * config.numAngles];
+        if (config.solver) {
+            sweepRowSolver(config, speedIndex, phase, row);
+        } else {
+            sweepRowStepped(config, lanes[worker], speedIndex, phase, hitFlags[worker], row);
+        }
+    });
+    const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    const double throws = (double)table.size() * config.samples;
+    printf("%s, %s, %d threads: %d x %d x %d cells, %d samples each\n",
+           config.solver ? "solver" : dynamicsName(config.lane.dynamics), integratorName(lanes[0].integrator()),
+           pool.numThreads(), NUM_BALL_SPEEDS, config.numAngles, config.numPhases, config.samples);
+    printf("%.3f s, %.4g throws/s, %lld of %d tasks stolen\n", seconds, throws / seconds, pool.steals(), numTasks);
+
+    const bool ok = format == "bin" ? writeBinary(output, config, table) : writeCSV(output, config, table);
+    if (!ok) {
+        fprintf(stderr, "Failed to write: %s\n", output.c_str());
+        exit(1);
+    }
+    printf("wrote %s\n", output.c_str());
+
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(int numThreads)
+: task_(NULL)
+, generation_(0)
+, pending_(0)
+, active_(0)
+, stop_(false)
+, steals_(0) {
+    if (numThreads <= 0) {
+        numThreads = (int)std::thread::hardware_concurrency();
+    }
+    if (numThreads <= 0) {
+        numThreads = 1;
+    }
+
+    for (int w = 0; w < numThreads; w++) {
+        queues_.push_back(new Queue());
+    }
+    for (int w = 0; w < numThreads; w++) {
+        threads_.push_back(std::thread(&ThreadPool::workerLoop, this, w));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    startCond_.notify_all();
+    for (size_t w = 0; w < threads_.size(); w++) {
+        threads_[w].join();
+    }
+    for (size_t w = 0; w < queues_.size(); w++) {
+        delete queues_[w];
+    }
+}
+
+void ThreadPool::run(int numTasks, const std::function<void(int, int)> &task) {
+    if (numTasks <= 0) {
+        return;
+    }
+
+    // 仕事を積む前に, この run() の task と数を公開しておく.
+    // スレッドは mutex_ を取ってからでないと仕事を探し始めないので, 積み終わるまでは誰も盗めない
+    std::unique_lock<std::mutex> lock(mutex_);
+    task_ = &task;
+    pending_ = numTasks;
+    steals_ = 0;
+    generation_++;
+
+    // 番号の連続した塊を各スレッドに配る (隣り合うタスクは同じスレッドが続けて処理する)
+    const int n = numThreads();
+    for (int w = 0; w < n; w++) {
+        const int begin = (int)((long long)numTasks * w / n);
+        const int end = (int)((long long)numTasks * (w + 1) / n);
+        std::lock_guard<std::mutex> queueLock(queues_[w]->mutex);
+        for (int t = begin; t < end; t++) {
+            queues_[w]->tasks.push_back(t);
+        }
+    }
+
+    startCond_.notify_all();
+    // 古い task を持ったままのスレッドが残らないように, 全員が探し終えるまで待つ
+    doneCond_.wait(lock, [this] { return pending_ == 0 && active_ == 0; });
+    task_ = NULL;
+}
+
+bool ThreadPool::takeTask(int worker, int *task) {
+    {
+        Queue &own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            *task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // 自分の分が尽きたら, 隣から順に他のスレッドのキューの末尾を盗む
+    const int n = numThreads();
+    for (int k = 1; k < n; k++) {
+        Queue &victim = *queues_[(worker + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.back();
+            victim.tasks.pop_back();
+            steals_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int worker) {
+    unsigned long long seen = 0;
+    for (;;) {
+        const std::function<void(int, int)> *task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            // 前の run() を寝過ごしたスレッドが, run() と run() の間 (task_ が NULL) に起きても探し始めない
+            startCond_.wait(lock, [this, seen] { return stop_ || (generation_ != seen && task_ != NULL); });
+            if (stop_) {
+                return;
+            }
+            seen = generation_;
+            task = task_;
+            active_++;
+        }
+
+        // 自分が active_ の間は run() が戻らないので, task と pending_ は見た世代のものから変わらない
+        int t;
+        int done = 0;
+        while (takeTask(worker, &t)) {
+            (*task)(t, worker);
+            done++;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ -= done;
+        active_--;
+        if (pending_ == 0 && active_ == 0) {
+            doneCond_.notify_all();
+        }
+    }
+}
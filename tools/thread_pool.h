@@ -0,0 +1,57 @@
+#ifndef _CORIOLIS_THREAD_POOL_H_
+#define _CORIOLIS_THREAD_POOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// 仕事を盗み合うスレッドプール.
+//
+// run() はタスクの番号を連続した塊に分けて各スレッドのキューに積む.
+// スレッドは自分のキューの先頭から取り, 空になったら他のスレッドのキューの末尾から盗む.
+// タスクごとの重さが大きく違っても (遅いボールほど長くかかる), 空いたスレッドが引き受ける.
+class ThreadPool {
+public:
+    // numThreads が 0 以下ならハードウェアのスレッド数
+    explicit ThreadPool(int numThreads = 0);
+    ~ThreadPool();
+
+    int numThreads() const { return (int)threads_.size(); }
+
+    // task(タスク番号, スレッド番号) を [0, numTasks) の全てについて呼び, 終わるまで待つ
+    void run(int numTasks, const std::function<void(int, int)> &task);
+
+    // 直前の run() で他のスレッドから盗んだタスクの数
+    long long steals() const { return steals_; }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    void workerLoop(int worker);
+    bool takeTask(int worker, int *task);
+
+    std::vector<std::thread> threads_;
+    std::vector<Queue *> queues_;
+
+    std::mutex mutex_;
+    std::condition_variable startCond_;
+    std::condition_variable doneCond_;
+    const std::function<void(int, int)> *task_;
+    unsigned long long generation_;     // run() ごとに増やす
+    int pending_;                       // 終わっていないタスクの数
+    int active_;                        // タスクを探しているスレッドの数
+    bool stop_;
+    std::atomic<long long> steals_;
+};
+
+#endif  // _CORIOLIS_THREAD_POOL_H_
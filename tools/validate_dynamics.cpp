@@ -0,0 +1,224 @@
+// 回転座標系の積分 (オイラー法, RK4) を, 元の直線の補間と比べる
+//
+//   $ ./coriolis_validate
+//
+// 円盤の角速度・ボールの速さ・投げる向きを変えながら1球ずつ投げ,
+// 円盤の上を転がっている間の慣性系での位置のずれの最大値, 円盤から落ちたステップのずれ,
+// ピンに当たったかどうかが食い違ったステップ数を表示する.
+//
+// オイラー法は1次の精度なので, ステップを 1/10 にするとずれもおよそ 1/10 になることも確かめる.
+// また, ステップを刻んだ結果と solveThrow() の結果が一致するかを, ステップの長さを変えて確かめる.
+// どれかが許容値を超えたら 0 以外で終わる.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "core/lane.h"
+#include "core/throw_solver.h"
+
+static const float OMEGAS[] = { 0.0f, 3.14159265f / 3.0f, 2.0f, 4.0f };
+static const int NUM_OMEGAS = (int)(sizeof(OMEGAS) / sizeof(OMEGAS[0]));
+static const float ARROW_ANGLES[] = { -1.2f, -0.6f, 0.0f, 0.35f, 0.9f, 1.4f };
+static const int NUM_ARROW_ANGLES = (int)(sizeof(ARROW_ANGLES) / sizeof(ARROW_ANGLES[0]));
+
+// 60 Hz で全部の速さと向きを投げたときの許容値 (ω ごと)
+struct Tolerance {
+    float maxError;
+    int dropOffset;
+    int hitMismatch;
+};
+
+// RK4 は直線の補間と丸め誤差の範囲で一致しなければならない.
+// オイラー法は 60 Hz では遅いボールほど (円盤に長く乗るほど) ずれが溜まるので,
+// いまの値より少しだけ緩い値を上限にして, 悪くなったら分かるようにする
+static const Tolerance EULER_TOLERANCES[NUM_OMEGAS] = {
+    { 1e-3f, 2, 2 },
+    { 0.6f, 600, 320 },
+    { 1.0f, 2600, 320 },
+    { 1.3f, 5200, 340 },
+};
+static const Tolerance RK4_TOLERANCES[NUM_OMEGAS] = {
+    { 1e-3f, 8, 4 },
+    { 1e-3f, 8, 4 },
+    { 1e-3f, 8, 4 },
+    { 1e-3f, 8, 4 },
+};
+
+// オイラー法の収束を調べる速さ (これより遅いボールは円盤に長く乗り, 細かく刻むと float の丸め誤差の方が大きくなる)
+static const int CONVERGENCE_MIN_SPEED = 5;
+// ステップを 1/10 にしたときのずれの比の上限 (1次の精度なら 0.1 くらい)
+static const float CONVERGENCE_RATIO = 0.2f;
+
+struct Trajectory {
+    float maxError;     // 円盤の上での直線の補間とのずれの最大値
+    int dropOffset;     // 円盤から落ちたステップのずれ
+    int hitMismatch;    // 当たり判定が食い違ったステップ数
+};
+
+static Trajectory compare(Dynamics dynamics, float hz, float omega, int speedIndex, float arrowAngle) {
+    LaneConfig config;
+    config.dt = 1.0f / hz;
+    config.omega = omega;
+    Lane chord(config);
+    config.dynamics = dynamics;
+    Lane rotating(config);
+
+    Trajectory result;
+    result.maxError = 0.0f;
+    result.hitMismatch = 0;
+
+    const float h = config.releaseHeight;
+    int chordDrop = -1;
+    int rotatingDrop = -1;
+
+    chord.setSpeedIndex(speedIndex);
+    rotating.setSpeedIndex(speedIndex);
+    chord.throwBall(arrowAngle);
+    rotating.throwBall(arrowAngle);
+    // 片方が先に落ちきっても, もう片方が落ちるまで刻み続ける
+    for (int step = 0; chord.numBalls() > 0 || rotating.numBalls() > 0; step++) {
+        const bool chordAlive = chord.numBalls() > 0;
+        const bool rotatingAlive = rotating.numBalls() > 0;
+        if (chordAlive) {
+            chord.step();
+        }
+        if (rotatingAlive) {
+            rotating.step();
+        }
+        const bool chordOnDisk = chord.numBalls() > 0 && chord.balls().posY()[0] == h;
+        const bool rotatingOnDisk = rotating.numBalls() > 0 && rotating.balls().posY()[0] == h;
+        if (chordOnDisk && rotatingOnDisk) {
+            const float dx = chord.balls().posX()[0] - rotating.balls().posX()[0];
+            const float dz = chord.balls().posZ()[0] - rotating.balls().posZ()[0];
+            result.maxError = std::max(result.maxError, std::sqrt(dx * dx + dz * dz));
+        }
+        if (chordDrop < 0 && !chordOnDisk) {
+            chordDrop = step;
+        }
+        if (rotatingDrop < 0 && !rotatingOnDisk) {
+            rotatingDrop = step;
+        }
+        const bool chordHit = chordAlive && chord.hit();
+        const bool rotatingHit = rotatingAlive && rotating.hit();
+        result.hitMismatch += (chordHit != rotatingHit) ? 1 : 0;
+    }
+    result.dropOffset = std::abs(chordDrop - rotatingDrop);
+    return result;
+}
+
+// minSpeed 以上の速さと全部の向きで投げたときの, 最も悪い値 (当たり判定の食い違いは合計)
+static Trajectory compareAll(Dynamics dynamics, float hz, float omega, int minSpeed) {
+    Trajectory worst;
+    worst.maxError = 0.0f;
+    worst.dropOffset = 0;
+    worst.hitMismatch = 0;
+    for (int s = minSpeed; s < NUM_BALL_SPEEDS; s++) {
+        for (int a = 0; a < NUM_ARROW_ANGLES; a++) {
+            const Trajectory t = compare(dynamics, hz, omega, s, ARROW_ANGLES[a]);
+            worst.maxError = std::max(worst.maxError, t.maxError);
+            worst.dropOffset = std::max(worst.dropOffset, t.dropOffset);
+            worst.hitMismatch += t.hitMismatch;
+        }
+    }
+    return worst;
+}
+
+// 1球だけ投げてステップを刻み, 一度でもピンに当たったか
+static bool steppedHit(const LaneConfig &config, float arrowAngle, int speedIndex, float *releaseTheta) {
+    Lane lane(config);
+    while (lane.theta() < *releaseTheta) {
+        lane.step();
+    }
+    *releaseTheta = lane.theta();
+
+    lane.setSpeedIndex(speedIndex);
+    lane.throwBall(arrowAngle);
+    bool hit = false;
+    while (lane.numBalls() > 0) {
+        lane.step();
+        hit = hit || lane.hit();
+    }
+    return hit;
+}
+
+// ステップを粗くしても (連続的な当たり判定のおかげで) すり抜けないことも確かめる
+// 食い違いがなければ true
+static bool validateSolver(float hz) {
+    LaneConfig config;
+    config.dt = 1.0f / hz;
+    const float tolerance = throwSolverTolerance(config);
+    int agree = 0;
+    int steppedOnly = 0;    // ステップでは当たったのに solveThrow() は外れ (あってはならない)
+    int solverOnly = 0;     // ステップの間をすり抜けた
+    int borderline = 0;     // ピンをかすめる投げ方で, ピンの弧を弦で近似した分だけ食い違った (throwSolverTolerance() 以内)
+    double solveSeconds = 0.0;
+
+    for (int s = 0; s < NUM_BALL_SPEEDS; s++) {
+        for (int a = 0; a <= 60; a++) {
+            for (int t = 0; t < 24; t++) {
+                const float arrowAngle = -1.5f + 0.05f * a;
+                float releaseTheta = 2.0f * 3.14159265f * t / 24.0f;
+                const bool stepped = steppedHit(config, arrowAngle, s, &releaseTheta);
+
+                const std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+                const ThrowSolution solution = solveThrow(config, arrowAngle, s, releaseTheta);
+                const std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+                solveSeconds += std::chrono::duration<double>(end - start).count();
+
+                if (stepped == solution.hit) {
+                    agree++;
+                } else if (std::fabs(solution.missDistance - config.hitRadius) <= tolerance) {
+                    borderline++;
+                } else if (stepped) {
+                    steppedOnly++;
+                } else {
+                    solverOnly++;
+                }
+            }
+        }
+    }
+
+    const int total = agree + borderline + steppedOnly + solverOnly;
+    printf("solveThrow vs %3.0f Hz: %d throws, %d agree, %d borderline (within %.2g), %d stepped-only hits, %d tunnelled hits, %.0f ns/solve\n",
+           hz, total, agree, borderline, tolerance, steppedOnly, solverOnly, solveSeconds * 1e9 / total);
+    return steppedOnly == 0 && solverOnly == 0;
+}
+
+int main() {
+    bool ok = true;
+    printf("%-6s %8s  %12s  %12s  %12s\n", "model", "omega", "max error", "drop offset", "hit mismatch");
+    for (int d = DYNAMICS_EULER; d < NUM_DYNAMICS; d++) {
+        for (int w = 0; w < NUM_OMEGAS; w++) {
+            const Trajectory t = compareAll((Dynamics)d, 60.0f, OMEGAS[w], 0);
+            const Tolerance &tolerance = d == DYNAMICS_EULER ? EULER_TOLERANCES[w] : RK4_TOLERANCES[w];
+            const bool pass = t.maxError <= tolerance.maxError && t.dropOffset <= tolerance.dropOffset &&
+                              t.hitMismatch <= tolerance.hitMismatch;
+            ok = ok && pass;
+            printf("%-6s %8.4f  %12.4g  %12d  %12d  %s\n", dynamicsName((Dynamics)d), OMEGAS[w], t.maxError, t.dropOffset,
+                   t.hitMismatch, pass ? "ok" : "FAILED");
+        }
+    }
+
+    printf("\neuler convergence (speed >= %d)\n", CONVERGENCE_MIN_SPEED);
+    for (int w = 1; w < NUM_OMEGAS; w++) {
+        const float coarse = compareAll(DYNAMICS_EULER, 60.0f, OMEGAS[w], CONVERGENCE_MIN_SPEED).maxError;
+        const float fine = compareAll(DYNAMICS_EULER, 600.0f, OMEGAS[w], CONVERGENCE_MIN_SPEED).maxError;
+        const bool pass = fine <= CONVERGENCE_RATIO * coarse;
+        ok = ok && pass;
+        printf("omega %6.4f: %.4g at 60 Hz, %.4g at 600 Hz (ratio %.3f)  %s\n", OMEGAS[w], coarse, fine, fine / coarse,
+               pass ? "ok" : "FAILED");
+    }
+
+    printf("\n");
+    ok = validateSolver(60.0f) && ok;
+    ok = validateSolver(20.0f) && ok;
+    ok = validateSolver(10.0f) && ok;
+
+    if (!ok) {
+        printf("\nvalidation failed\n");
+        return 1;
+    }
+    return 0;
+}